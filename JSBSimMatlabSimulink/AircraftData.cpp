@@ -0,0 +1,74 @@
+#include "StdAfx.h"
+#include "AircraftData.h"
+#include "InputJournal.h"
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <algorithm>
+
+using namespace JSBSim;
+
+// one entry per aircraft file, dropped with the last instance holding it
+static std::mutex CacheMutex;
+static std::map<string, std::weak_ptr<const AircraftData> > Cache;
+
+AircraftDataPtr AircraftCache::Acquire(FGFDMExec *exec)
+{
+	const string name = exec->GetModelName();
+	const string file = name.empty() ? string() : exec->GetFullAircraftPath() + "/" + name + ".xml";
+	const uint64_t file_hash = file.empty() ? 0 : InputJournal::HashFile(file);
+
+	std::lock_guard<std::mutex> lock(CacheMutex);
+	std::map<string, std::weak_ptr<const AircraftData> >::iterator it = Cache.begin();
+	while (it != Cache.end())
+	{
+		if (it->second.expired()) Cache.erase(it++);
+		else ++it;
+	}
+	it = Cache.find(file);
+	if (it != Cache.end())
+	{
+		AircraftDataPtr shared = it->second.lock();
+		if (shared && shared->file_hash == file_hash)
+			return shared;
+	}
+
+	// the first instance of this file builds the data from its own tree
+	std::shared_ptr<AircraftData> data(new AircraftData);
+	data->name = name;
+	data->file = file;
+	data->file_hash = file_hash;
+	data->catalog = exec->SPrintPropertyCatalog();
+	std::sort(data->catalog.begin(), data->catalog.end());
+	vector<FGPropertyManager*> nodes;
+	CollectProperties(exec->GetPropertyManager(), "", data->properties, nodes);
+	Cache[file] = data;
+	return data;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+// the numeric leaves that can be read and written back, as paths relative to the JSBSim root
+void AircraftCache::CollectProperties(FGPropertyManager *node, const string path, vector<string>& names,
+									  vector<FGPropertyManager*>& nodes)
+{
+	for (int i=0; i<node->nChildren(); i++)
+	{
+		FGPropertyManager *child = static_cast<FGPropertyManager *>(node->getChild(i));
+		std::ostringstream name;
+		name << path << child->getName();
+		if (child->getIndex() > 0) name << "[" << child->getIndex() << "]";
+		if (child->nChildren() > 0)
+			CollectProperties(child, name.str() + "/", names, nodes);
+		else if (child->getAttribute(SGPropertyNode::READ) && child->getAttribute(SGPropertyNode::WRITE))
+			switch (child->getType())
+			{
+			case SGPropertyNode::BOOL: case SGPropertyNode::INT: case SGPropertyNode::LONG:
+			case SGPropertyNode::FLOAT: case SGPropertyNode::DOUBLE:
+				names.push_back(name.str());
+				nodes.push_back(child);
+				break;
+			default:
+				break;
+			}
+	}
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
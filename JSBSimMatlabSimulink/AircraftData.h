@@ -0,0 +1,55 @@
+#ifndef AIRCRAFTDATA_HEADER_H
+#define AIRCRAFTDATA_HEADER_H
+
+#include <FGFDMExec.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+using std::string;
+using std::vector;
+
+/// The catalog and property names every instance of one aircraft shares, read-only once built
+struct AircraftData
+{
+	string name;				// model name, empty before an aircraft is loaded
+	string file;				// full path of the aircraft file
+	uint64_t file_hash;			// InputJournal::HashFile of it, 0 if it could not be read
+	vector<string> catalog;		// property catalog, sorted
+	vector<string> properties;	// readable and writable numeric properties, the snapshot list
+};
+typedef std::shared_ptr<const AircraftData> AircraftDataPtr;
+
+/// Reference-counted cache of the catalog and property-name lists of each loaded aircraft
+/*
+	Every JSBSimInterface used to build and keep its own property catalog,
+	and every snapshot its own copy of the property list, although they are
+	the same for all instances of one aircraft file. Acquire() builds them
+	from the first instance that loads the file and hands the same
+	immutable AircraftData to every later one, until the last instance
+	holding it is deleted. An entry is keyed by the aircraft file's path
+	and rebuilt when the file's hash changes. Acquire() locks, so ensemble
+	and rollout workers load their instances on their own threads; reading
+	the data needs no lock.
+
+	This only removes the duplicated name lists. It does not share the
+	parsed model: every FGFDMExec still parses the aircraft file and keeps
+	its own aerodynamic and engine tables, FCS components and mass
+	properties, bound to its own property tree, so the per-instance memory
+	of an ensemble is about what it was. Sharing those needs JSBSim to
+	share its FGTable and FGFunction data between executives, which this
+	tree does not do yet.
+*/
+class AircraftCache
+{
+public:
+	/// The shared data of the aircraft exec has loaded, or of an empty exec
+	static AircraftDataPtr Acquire(JSBSim::FGFDMExec *exec);
+
+	/// Readable and writable numeric properties below node, depth first
+	static void CollectProperties(JSBSim::FGPropertyManager *node, const string path,
+								  vector<string>& names, vector<JSBSim::FGPropertyManager*>& nodes);
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
@@ -0,0 +1,326 @@
+#include "StdAfx.h"
+#include "DatalogReader.h"
+#include <string.h>
+#include <stdlib.h>
+#include <limits>
+#include <thread>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static inline bool IsBlank(char c){return c == ' ' || c == '\t' || c == '\r';}
+
+static bool IsBlankLine(const char *p, const char *end)
+{
+	while (p < end && IsBlank(*p)) p++;
+	return p == end;
+}
+
+// end of the line starting at p, i.e. its '\n' or the end of the data
+static inline const char *LineEnd(const char *p, const char *end)
+{
+	const char *nl = (const char *) memchr(p, '\n', end - p);
+	return nl ? nl : end;
+}
+
+// Parse one field [p, end) as a double; exact powers of ten up to 1e22
+// make mantissa*10^e correctly rounded when the mantissa fits 53 bits
+static double ParseField(const char *p, const char *end)
+{
+	static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+	while (p < end && IsBlank(*p)) p++;
+	while (end > p && IsBlank(end[-1])) end--;
+	if (p == end) return std::numeric_limits<double>::quiet_NaN();
+
+	const char *s = p;
+	bool negative = false;
+	if (*s == '-' || *s == '+') negative = (*s++ == '-');
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any = false, truncated = false;
+	for (; s < end && *s >= '0' && *s <= '9'; s++, any = true)
+	{
+		if (digits < 19) { mantissa = mantissa*10 + (*s - '0'); if (mantissa) digits++; }
+		else { exponent++; truncated = truncated || *s != '0'; }
+	}
+	if (s < end && *s == '.')
+		for (s++; s < end && *s >= '0' && *s <= '9'; s++, any = true)
+		{
+			if (digits < 19) { mantissa = mantissa*10 + (*s - '0'); if (mantissa) digits++; exponent--; }
+			else truncated = truncated || *s != '0';
+		}
+	if (any && s < end && (*s == 'e' || *s == 'E'))
+	{
+		const char *e = s + 1;
+		bool eneg = false;
+		if (e < end && (*e == '-' || *e == '+')) eneg = (*e++ == '-');
+		int ev = 0;
+		bool edigits = false;
+		for (; e < end && *e >= '0' && *e <= '9'; e++, edigits = true)
+			if (ev < 10000) ev = ev*10 + (*e - '0');
+		if (edigits)
+		{
+			exponent += eneg ? -ev : ev;
+			s = e;
+		}
+	}
+
+	if (any && s == end && !truncated)
+	{
+		// trailing zeros of the fraction do not need mantissa bits
+		while (mantissa && mantissa % 10 == 0 && exponent < 0)
+		{
+			mantissa /= 10;
+			exponent++;
+		}
+		if (mantissa == 0) return negative ? -0.0 : 0.0;
+		if (mantissa <= (((uint64_t)1) << 53) && exponent >= -22 && exponent <= 22)
+		{
+			double value = (double) mantissa;
+			value = (exponent < 0) ? value / pow10[-exponent] : value * pow10[exponent];
+			return negative ? -value : value;
+		}
+	}
+
+	// long mantissas, "nan", "inf" and anything odd go through strtod; a
+	// field too long for the stack buffer (e.g. 0.000...1) is copied to the heap
+	char buf[64];
+	string long_field;
+	size_t n = end - p;
+	char *text = buf;
+	if (n >= sizeof(buf))
+	{
+		long_field.assign(p, n);
+		text = &long_field[0];
+	}
+	else
+	{
+		memcpy(buf, p, n);
+		buf[n] = 0;
+	}
+	char *stop;
+	double value = strtod(text, &stop);
+	return (stop == text + n) ? value : std::numeric_limits<double>::quiet_NaN();
+}
+
+DatalogReader::DatalogReader(void)
+{
+	_data = 0L;
+	_size = 0;
+	_body = 0L;
+	_rows = 0;
+#ifdef _WIN32
+	_file = INVALID_HANDLE_VALUE;
+	_mapping = 0L;
+#else
+	_fd = -1;
+#endif
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+DatalogReader::~DatalogReader(void)
+{
+	Close();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool DatalogReader::Open(const string file)
+{
+	Close();
+#ifdef _WIN32
+	_file = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (_file == INVALID_HANDLE_VALUE) return 0;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx((HANDLE)_file, &size) || size.QuadPart == 0) { Close(); return 0; }
+	_size = (size_t) size.QuadPart;
+	_mapping = CreateFileMappingA((HANDLE)_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (_mapping == NULL) { Close(); return 0; }
+	_data = (const char *) MapViewOfFile((HANDLE)_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (_data == NULL) { Close(); return 0; }
+#else
+	_fd = open(file.c_str(), O_RDONLY);
+	if (_fd < 0) return 0;
+	struct stat st;
+	if (fstat(_fd, &st) != 0 || st.st_size == 0) { Close(); return 0; }
+	_size = (size_t) st.st_size;
+	void *base = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	if (base == MAP_FAILED) { Close(); return 0; }
+	_data = (const char *) base;
+	madvise(base, _size, MADV_SEQUENTIAL);
+#endif
+
+	// header: the column names
+	const char *end = _data + _size;
+	const char *eol = LineEnd(_data, end);
+	const char *p = _data;
+	if (eol - p >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) p += 3; // UTF-8 byte order mark
+	while (p <= eol)
+	{
+		const char *comma = (const char *) memchr(p, ',', eol - p);
+		const char *field_end = comma ? comma : eol;
+		const char *b = p, *e = field_end;
+		while (b < e && IsBlank(*b)) b++;
+		while (e > b && IsBlank(e[-1])) e--;
+		_names.push_back(string(b, e));
+		p = field_end + 1;
+	}
+	_body = (eol < end) ? eol + 1 : end;
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void DatalogReader::Close(void)
+{
+#ifdef _WIN32
+	if (_data) UnmapViewOfFile(_data);
+	if (_mapping) CloseHandle((HANDLE)_mapping);
+	if (_file != INVALID_HANDLE_VALUE) CloseHandle((HANDLE)_file);
+	_file = INVALID_HANDLE_VALUE;
+	_mapping = 0L;
+#else
+	if (_data) munmap((void *)_data, _size);
+	if (_fd >= 0) close(_fd);
+	_fd = -1;
+#endif
+	_data = 0L;
+	_size = 0;
+	_body = 0L;
+	_rows = 0;
+	_names.clear();
+	_blocks.clear();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+int DatalogReader::FindColumn(const string name)
+{
+	for (unsigned i=0; i<_names.size(); i++)
+		if (_names[i] == name) return (int)i;
+	return -1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+size_t DatalogReader::CountRows(int threads)
+{
+	_blocks.clear();
+	_rows = 0;
+	if (!_data) return 0;
+	if (threads <= 0) threads = (int) std::thread::hardware_concurrency();
+	if (threads <= 0) threads = 1;
+
+	// one block per thread, each ending just after a line break
+	const char *end = _data + _size;
+	size_t body = end - _body;
+	const char *begin = _body;
+	for (int t=0; t<threads && begin < end; t++)
+	{
+		const char *cut = (t == threads - 1) ? end : _body + body*(t+1)/threads;
+		if (cut < begin) cut = begin;
+		if (cut < end) cut = LineEnd(cut, end);
+		if (cut < end) cut++;
+		Block block = {begin, cut, 0, 0};
+		_blocks.push_back(block);
+		begin = cut;
+	}
+
+	// rows per block in parallel, then their offsets
+	vector<std::thread> pool;
+	for (unsigned b=0; b<_blocks.size(); b++)
+		pool.push_back(std::thread([this, b]() {
+			Block& block = _blocks[b];
+			for (const char *p = block.begin; p < block.end; )
+			{
+				const char *eol = LineEnd(p, block.end);
+				if (!IsBlankLine(p, eol)) block.rows++;
+				p = eol + 1;
+			}
+		}));
+	for (unsigned t=0; t<pool.size(); t++)
+		pool[t].join();
+	for (unsigned b=0; b<_blocks.size(); b++)
+	{
+		_blocks[b].first_row = _rows;
+		_rows += _blocks[b].rows;
+	}
+	return _rows;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void DatalogReader::Parse(const vector<int>& columns, double *out)
+{
+	// output column of every file column, -1 for the ones not asked for
+	vector<int> target(_names.size(), -1);
+	for (unsigned k=0; k<columns.size(); k++)
+		if (columns[k] >= 0 && columns[k] < (int)_names.size())
+			target[columns[k]] = (int)k;
+	// columns asked for twice, or not in the file, are filled afterwards
+	vector<std::thread> pool;
+	for (unsigned b=0; b<_blocks.size(); b++)
+		pool.push_back(std::thread(&DatalogReader::ParseBlock, this, _blocks[b], target, out, _rows));
+	for (unsigned t=0; t<pool.size(); t++)
+		pool[t].join();
+
+	for (unsigned k=0; k<columns.size(); k++)
+	{
+		int c = columns[k];
+		if (c < 0 || c >= (int)_names.size())
+			for (size_t r=0; r<_rows; r++)
+				out[r + k*_rows] = std::numeric_limits<double>::quiet_NaN();
+		else if (target[c] != (int)k)
+			memcpy(out + k*_rows, out + target[c]*_rows, _rows*sizeof(double));
+	}
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void DatalogReader::ParseBlock(const Block& block, const vector<int>& target, double *out, size_t rows)
+{
+	// rows are parsed into a row-major tile first and written out a tile at
+	// a time, so the column-major stores hit a few cache lines per column
+	// instead of one page per value
+	enum {TileRows = 64};
+	const int ncols = (int) target.size();
+	int width = 0;
+	for (int c=0; c<ncols; c++)
+		if (target[c] >= 0 && target[c] + 1 > width) width = target[c] + 1;
+	// no column of the file is asked for: Parse fills every output column with NaN
+	if (width == 0) return;
+	vector<double> tile(TileRows*width);
+	size_t row = block.first_row;
+	int n = 0;
+	for (const char *p = block.begin; p < block.end; )
+	{
+		const char *eol = LineEnd(p, block.end);
+		if (IsBlankLine(p, eol)) { p = eol + 1; continue; }
+
+		double *values = &tile[n*width];
+		int col = 0;
+		const char *field = p;
+		while (col < ncols)
+		{
+			const char *comma = (const char *) memchr(field, ',', eol - field);
+			const char *field_end = comma ? comma : eol;
+			if (target[col] >= 0)
+				values[target[col]] = ParseField(field, field_end);
+			col++;
+			if (!comma) break;
+			field = comma + 1;
+		}
+		// a short line gets NaN in its missing columns
+		for (; col < ncols; col++)
+			if (target[col] >= 0)
+				values[target[col]] = std::numeric_limits<double>::quiet_NaN();
+		p = eol + 1;
+
+		if (++n == TileRows)
+		{
+			for (int k=0; k<width; k++)
+				for (int r=0; r<n; r++)
+					out[row + r + k*rows] = tile[r*width + k];
+			row += n;
+			n = 0;
+		}
+	}
+	for (int k=0; k<width; k++)
+		for (int r=0; r<n; r++)
+			out[row + r + k*rows] = tile[r*width + k];
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
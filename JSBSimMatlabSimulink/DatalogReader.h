@@ -0,0 +1,66 @@
+#ifndef DATALOGREADER_HEADER_H
+#define DATALOGREADER_HEADER_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+using std::string;
+using std::vector;
+
+/// Reads a JSBSim CSV datalog (output type="CSV") through a memory map
+/*
+	The first line holds the column names, e.g. "Time, V_{Total} (ft/s)",
+	taken verbatim apart from the surrounding blanks. Every other line is
+	one row of comma separated numbers; missing or unreadable fields become
+	NaN, fields beyond the header are ignored.
+
+	Parsing runs on several threads: the data is cut into one block per
+	thread at line boundaries, each thread counts the rows of its block,
+	then parses them straight into their place in a column-major matrix,
+	so a Matlab array can be filled without a copy. Numbers go through a
+	fast decimal parser that is exact whenever the digits fit in a double
+	(Clinger's fast path) and falls back to strtod otherwise.
+*/
+class DatalogReader
+{
+public:
+	DatalogReader(void);
+	~DatalogReader(void);
+
+	/// Map the file and read its header, false if it cannot be opened or is empty
+	bool Open(const string file);
+	void Close(void);
+
+	const vector<string>& GetColumnNames(){return _names;}
+	/// Index of a column name, -1 if there is none
+	int FindColumn(const string name);
+
+	/// Count the data rows, cutting the data into one block per thread (0 = all cores)
+	size_t CountRows(int threads);
+	/// Parse the selected columns (indices into the names) into out[row + k*rows]
+	void Parse(const vector<int>& columns, double *out);
+
+private:
+	struct Block
+	{
+		const char *begin, *end;
+		size_t first_row, rows;
+	};
+	void ParseBlock(const Block& block, const vector<int>& target, double *out, size_t rows);
+
+	const char *_data;
+	size_t _size;
+	const char *_body;			// first byte after the header line
+	vector<string> _names;
+	vector<Block> _blocks;
+	size_t _rows;
+#ifdef _WIN32
+	void *_file, *_mapping;
+#else
+	int _fd;
+#endif
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
@@ -0,0 +1,206 @@
+#include "StdAfx.h"
+#include "EnsembleRunner.h"
+#include <thread>
+#include <chrono>
+
+typedef std::chrono::steady_clock EnsembleClock;
+
+static double SecondsSince(EnsembleClock::time_point start)
+{
+	return std::chrono::duration<double>(EnsembleClock::now() - start).count();
+}
+
+EnsembleRunner::EnsembleRunner(const string aircraft, double dt, const vector<string>& ic_names,
+		const vector<string>& watch)
+	: _aircraft(aircraft), _dt(dt), _watch(watch),
+	  _chunk(0.0), _cases(0L), _remaining(0), _queued(0)
+{
+	for (unsigned i=0; i<ic_names.size(); i++)
+		if (ic_names[i] != "multiplier")
+		{
+			_ic_names.push_back(ic_names[i]);
+			_ic_columns.push_back((int)i);
+		}
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void EnsembleRunner::Run(const vector<EnsembleCase>& cases, int threads, double chunk_seconds)
+{
+	if (threads < 1) threads = 1;
+	_cases = &cases;
+	_chunk = chunk_seconds;
+	_results.assign(cases.size(), EnsembleResult());
+	_stats.assign(threads, EnsembleWorkerStats());
+	_remaining.store((int)cases.size());
+	_queued.store((int)cases.size());
+
+	// deal the cases out round robin, stealing evens out the rest
+	_workers.resize(threads);
+	for (int w=0; w<threads; w++)
+		_workers[w] = new Worker;
+	for (unsigned i=0; i<cases.size(); i++)
+	{
+		Task task = {(int)i, 0L, 0L};
+		_workers[i % threads]->tasks.push_back(task);
+	}
+
+	vector<std::thread> pool;
+	for (int w=1; w<threads; w++)
+		pool.push_back(std::thread(&EnsembleRunner::WorkerLoop, this, w));
+	WorkerLoop(0); // the calling thread is worker 0
+	for (unsigned t=0; t<pool.size(); t++)
+		pool[t].join();
+
+	for (int w=0; w<threads; w++)
+		delete _workers[w];
+	_workers.clear();
+	_cases = 0L;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void EnsembleRunner::WorkerLoop(int id)
+{
+	EnsembleClock::time_point start = EnsembleClock::now();
+	EnsembleWorkerStats& stats = _stats[id];
+	Task task;
+	while (_remaining.load() > 0)
+	{
+		if (!NextTask(id, task))
+		{
+			// everything left is in flight on other workers, one may come back as a chunk
+			std::unique_lock<std::mutex> lock(_idle_lock);
+			_idle_cv.wait(lock, [this]{ return _remaining.load() == 0 || _queued.load() > 0; });
+			continue;
+		}
+		EnsembleClock::time_point busy = EnsembleClock::now();
+		bool finished = RunChunk(id, task);
+		stats.busy += SecondsSince(busy);
+		stats.chunks++;
+		if (finished)
+		{
+			stats.runs++;
+			if (_remaining.fetch_sub(1) == 1)
+				WakeIdle(true);
+		}
+		else
+		{
+			{
+				Worker& own = *_workers[id];
+				std::lock_guard<std::mutex> guard(own.lock);
+				own.tasks.push_back(task);
+			}
+			_queued.fetch_add(1);
+			WakeIdle(false);
+		}
+	}
+	stats.wall = SecondsSince(start);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool EnsembleRunner::NextTask(int id, Task& task)
+{
+	{
+		// own work first, from the back
+		Worker& own = *_workers[id];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.tasks.empty())
+		{
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			_queued.fetch_sub(1);
+			return 1;
+		}
+	}
+	// then steal the oldest task of the next worker that has one
+	const int n = (int)_workers.size();
+	for (int k=1; k<n; k++)
+	{
+		Worker& victim = *_workers[(id + k) % n];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.tasks.empty())
+		{
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			_queued.fetch_sub(1);
+			_stats[id].steals++;
+			return 1;
+		}
+	}
+	return 0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void EnsembleRunner::WakeIdle(bool all)
+{
+	// taking the lock orders the change before a sleeper's check of it
+	{
+		std::lock_guard<std::mutex> guard(_idle_lock);
+	}
+	if (all) _idle_cv.notify_all();
+	else _idle_cv.notify_one();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool EnsembleRunner::RunChunk(int id, Task& task)
+{
+	const EnsembleCase& c = (*_cases)[task.index];
+	EnsembleResult& result = _results[task.index];
+
+	if (!task.exec)
+	{
+		{
+			std::lock_guard<std::mutex> guard(_load_lock);
+			task.exec = new FGFDMExec();
+			task.ji = new JSBSimInterface(task.exec, _dt, false);
+			task.ji->SetVerbosity(JSBSimInterface::eSilent);
+			result.ok = task.ji->Open(_aircraft);
+		}
+		if (result.ok)
+		{
+			vector<double> values;
+			for (unsigned i=0; i<_ic_columns.size(); i++)
+				values.push_back(c.ic_values[_ic_columns[i]]);
+			JIInitList list;
+			task.ji->ResolveInitList(_ic_names, list);
+			result.ok = task.ji->Init(list, values.empty() ? 0L : &values[0]);
+		}
+		for (unsigned i=0; i<_stops.size() && result.ok; i++)
+			result.ok = task.ji->AddStopCondition(_stops[i]) != 0;
+		for (unsigned i=0; i<_stat_specs.size() && result.ok; i++)
+			result.ok = task.ji->AddStatistic(_stat_specs[i]) != 0;
+	}
+
+	bool finished = !result.ok;
+	if (result.ok)
+	{
+		double end = c.duration;
+		if (_chunk > 0.0 && task.exec->GetSimTime() + _chunk < end)
+			end = task.exec->GetSimTime() + _chunk;
+		// half a step of slack so that rounding of sim-time does not add a frame
+		while (task.exec->GetSimTime() + 0.5*_dt < end && !task.ji->IsStopped())
+		{
+			task.ji->StepFDMExec();
+		}
+		finished = task.ji->IsStopped() || task.exec->GetSimTime() + 0.5*_dt >= c.duration;
+	}
+	if (!finished) return 0;
+
+	result.sim_time = task.exec->GetSimTime();
+	result.stop_reason = task.ji->GetStopReason();
+	result.worker = id;
+	result.watch.assign(_watch.size(), 0.0);
+	result.stats.clear();
+	if (result.ok)
+	{
+		for (unsigned i=0; i<_watch.size(); i++)
+		{
+			FGPropertyManager *node = task.exec->GetPropertyManager()->GetNode(_watch[i]);
+			if (node) result.watch[i] = node->getDoubleValue();
+		}
+		// the summaries are all that is kept of the run
+		for (unsigned i=0; i<task.ji->GetStatistics().size(); i++)
+			result.stats.push_back(task.ji->GetStatistics()[i].stats);
+	}
+
+	delete task.ji;
+	delete task.exec;
+	task.ji = 0L;
+	task.exec = 0L;
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -0,0 +1,112 @@
+#ifndef ENSEMBLERUNNER_HEADER_H
+#define ENSEMBLERUNNER_HEADER_H
+
+#include "JSBSimInterface.h"
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/// One case of an ensemble
+struct EnsembleCase
+{
+	vector<double> ic_values;	// one value per EnsembleRunner IC name
+	double duration;			// simulated seconds
+};
+
+/// Outcome of one case
+struct EnsembleResult
+{
+	bool ok;					// aircraft loaded and initialized
+	double sim_time;			// simulated seconds reached, the stop time if stopped early
+	int stop_reason;			// stop condition that ended the case, 0 if it ran its duration
+	vector<double> watch;		// watched properties at the end of the run
+	vector<SignalStats> stats;	// one summary per statistic
+	int worker;					// worker that finished the case
+};
+
+/// Per-worker accounting of the last Run()
+struct EnsembleWorkerStats
+{
+	double busy;				// seconds spent loading and stepping aircraft
+	double wall;				// seconds from the start of Run() to the worker's exit
+	int runs, chunks, steals;
+	double Utilization() const {return wall > 0.0 ? busy/wall : 0.0;}
+};
+
+/// Runs many independent cases of one aircraft on a pool of threads
+/*
+	Each case is a task that owns a private FGFDMExec and JSBSimInterface,
+	created when the task first runs and freed when it ends, so nothing is
+	locked on the step path. A task advances at most chunk_seconds of sim
+	time before it goes back to the end of its worker's deque; an idle
+	worker steals from the front of another worker's deque, so runs that
+	end after 20 s and runs that fly for 30 minutes still keep every core
+	busy until the last few chunks, and a stolen long run simply moves
+	its instance to the thief.
+
+	Workers never call the MEX API: instances are created without the
+	start-up messages and with silent verbosity, and a "multiplier" IC
+	name, which only matters to UpdateStates and prints unconditionally,
+	is dropped. Only creating and loading an instance is serialized,
+	because JSBSim keeps a few static counters; initialization and
+	stepping are not. A worker with nothing to run or steal sleeps until
+	a chunk is put back or the last case ends.
+	IC names are those of JSBSimInterface::ResolveInitList. Stop
+	conditions (JSBSimInterface::AddStopCondition) are checked after every
+	step, a case that trips one ends there and frees its worker at once.
+*/
+class EnsembleRunner
+{
+public:
+	EnsembleRunner(const string aircraft, double dt, const vector<string>& ic_names,
+		const vector<string>& watch);
+
+	/// Conditions that end a case early, e.g. "position/h-agl-ft < 10" or "nan"
+	void SetStopConditions(const vector<string>& stops){_stops = stops;}
+
+	/// Statistics kept over every step of a case, e.g. "accelerations/Nz q 0.99 > 3.8"
+	void SetStatistics(const vector<string>& stats){_stat_specs = stats;}
+
+	/// Run all cases; chunk_seconds <= 0 runs each case in one piece
+	void Run(const vector<EnsembleCase>& cases, int threads, double chunk_seconds);
+
+	const vector<EnsembleResult>& GetResults(){return _results;}
+	const vector<EnsembleWorkerStats>& GetWorkerStats(){return _stats;}
+
+private:
+	struct Task
+	{
+		int index;				// case number
+		FGFDMExec *exec;		// NULL until the first chunk
+		JSBSimInterface *ji;
+	};
+	struct Worker
+	{
+		std::mutex lock;		// only taken to push, pop or steal tasks
+		std::deque<Task> tasks;
+	};
+
+	void WorkerLoop(int id);
+	bool NextTask(int id, Task& task);
+	/// Advance a task by one chunk, true when the case is finished
+	bool RunChunk(int id, Task& task);
+
+	string _aircraft;
+	double _dt;
+	vector<string> _ic_names, _watch, _stops, _stat_specs;
+	vector<int> _ic_columns;	// column of EnsembleCase::ic_values for each IC name kept
+	double _chunk;
+	const vector<EnsembleCase> *_cases;
+	vector<EnsembleResult> _results;
+	vector<EnsembleWorkerStats> _stats;
+	vector<Worker*> _workers;
+	std::mutex _load_lock;
+	std::atomic<int> _remaining;
+	std::atomic<int> _queued;	// tasks waiting in the deques
+	std::mutex _idle_lock;
+	std::condition_variable _idle_cv;
+	void WakeIdle(bool all);
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
@@ -0,0 +1,253 @@
+#include "StdAfx.h"
+#include "HistoryBuffer.h"
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static uint64_t DoubleBits(double x)
+{
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	return bits;
+}
+
+static double BitsDouble(uint64_t bits)
+{
+	double x;
+	memcpy(&x, &bits, sizeof(x));
+	return x;
+}
+
+// leading and trailing zero bits of a non-zero word
+static int LeadingZeros(uint64_t x)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanReverse64(&i, x);
+	return 63 - (int)i;
+#else
+	return __builtin_clzll(x);
+#endif
+}
+
+static int TrailingZeros(uint64_t x)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward64(&i, x);
+	return (int)i;
+#else
+	return __builtin_ctzll(x);
+#endif
+}
+
+// n bits read MSB first at bit position pos, n <= 64
+static uint64_t Get(const vector<uint64_t>& words, size_t& pos, int n)
+{
+	if (n == 0) return 0;
+	size_t word = pos >> 6;
+	int used = (int)(pos & 63);
+	int avail = 64 - used;
+	uint64_t value;
+	if (n <= avail)
+	{
+		value = words[word] << used;
+		value = (n == 64) ? value : value >> (64 - n);
+	}
+	else
+	{
+		uint64_t high = (words[word] << used) >> used;	// the avail low bits
+		uint64_t low = words[word+1] >> (64 - (n - avail));
+		value = (high << (n - avail)) | low;
+	}
+	pos += n;
+	return value;
+}
+
+CompressedSeries::CompressedSeries(bool delta_prediction)
+{
+	_delta = delta_prediction;
+	Clear();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void CompressedSeries::Clear(void)
+{
+	_chunks.clear();
+	_size = 0;
+	_p1 = _p2 = 0.0;
+	_lead = _trail = -1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void CompressedSeries::Put(Chunk& chunk, uint64_t value, int n)
+{
+	if (n == 0) return;
+	if (n < 64) value &= (((uint64_t)1) << n) - 1;
+	size_t word = chunk.nbits >> 6;
+	int used = (int)(chunk.nbits & 63);
+	if (word == chunk.words.size()) chunk.words.push_back(0);
+	int avail = 64 - used;
+	if (n <= avail)
+		chunk.words[word] |= value << (avail - n);
+	else
+	{
+		chunk.words[word] |= value >> (n - avail);
+		chunk.words.push_back(value << (64 - (n - avail)));
+	}
+	chunk.nbits += n;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+double CompressedSeries::Predict(unsigned count, double p1, double p2) const
+{
+	if (_delta && count >= 2) return 2.0*p1 - p2;
+	return p1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void CompressedSeries::Append(double x)
+{
+	if (_chunks.empty() || _chunks.back().count == ChunkSize)
+	{
+		Chunk chunk;
+		chunk.nbits = 0;
+		chunk.count = 0;
+		_chunks.push_back(chunk);
+		_lead = _trail = -1;
+	}
+	Chunk& chunk = _chunks.back();
+
+	if (chunk.count == 0)
+		Put(chunk, DoubleBits(x), 64);
+	else
+	{
+		uint64_t xor_bits = DoubleBits(x) ^ DoubleBits(Predict(chunk.count, _p1, _p2));
+		if (xor_bits == 0)
+			Put(chunk, 0, 1);
+		else
+		{
+			int lead = LeadingZeros(xor_bits);
+			int trail = TrailingZeros(xor_bits);
+			if (lead > 31) lead = 31;
+			if (_lead >= 0 && lead >= _lead && trail >= _trail)
+			{
+				Put(chunk, 2, 2);
+				Put(chunk, xor_bits >> _trail, 64 - _lead - _trail);
+			}
+			else
+			{
+				int len = 64 - lead - trail;
+				Put(chunk, 3, 2);
+				Put(chunk, lead, 5);
+				Put(chunk, len & 63, 6); // 64 is written as 0
+				Put(chunk, xor_bits >> trail, len);
+				_lead = lead;
+				_trail = trail;
+			}
+		}
+	}
+	_p2 = _p1;
+	_p1 = x;
+	chunk.count++;
+	_size++;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+size_t CompressedSeries::Bytes() const
+{
+	size_t bytes = 0;
+	for (size_t c=0; c<_chunks.size(); c++)
+		bytes += _chunks[c].words.size()*sizeof(uint64_t) + sizeof(Chunk);
+	return bytes;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void CompressedSeries::Decode(double *out, size_t first, size_t count) const
+{
+	if (first + count > _size) return;
+	size_t end = first + count;
+	// chunks before the first sample are skipped without decoding
+	for (size_t c = first/ChunkSize; c<_chunks.size() && c*ChunkSize < end; c++)
+	{
+		const Chunk& chunk = _chunks[c];
+		size_t pos = 0, index = c*ChunkSize;
+		double p1 = 0.0, p2 = 0.0, x;
+		int lead = -1, trail = -1;
+		for (unsigned k=0; k<chunk.count && index < end; k++, index++)
+		{
+			if (k == 0)
+				x = BitsDouble(Get(chunk.words, pos, 64));
+			else
+			{
+				uint64_t xor_bits = 0;
+				if (Get(chunk.words, pos, 1))
+				{
+					if (Get(chunk.words, pos, 1))
+					{
+						lead = (int)Get(chunk.words, pos, 5);
+						int len = (int)Get(chunk.words, pos, 6);
+						if (len == 0) len = 64;
+						trail = 64 - lead - len;
+					}
+					xor_bits = Get(chunk.words, pos, 64 - lead - trail) << trail;
+				}
+				x = BitsDouble(xor_bits ^ DoubleBits(Predict(k, p1, p2)));
+			}
+			if (index >= first) out[index - first] = x;
+			p2 = p1;
+			p1 = x;
+		}
+	}
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+HistoryBuffer::HistoryBuffer(void) : _time(true)
+{
+	_num_signals = 0;
+	_decimation = 1;
+	_frame = 0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool HistoryBuffer::Open(int num_signals, int decimation)
+{
+	Close();
+	if (num_signals <= 0) return 0;
+	_num_signals = num_signals;
+	_decimation = decimation < 1 ? 1 : decimation;
+	_signals.assign(num_signals, CompressedSeries(true));
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void HistoryBuffer::Close(void)
+{
+	_num_signals = 0;
+	_signals.clear();
+	Clear();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void HistoryBuffer::Clear(void)
+{
+	_frame = 0;
+	_time.Clear();
+	for (unsigned i=0; i<_signals.size(); i++)
+		_signals[i].Clear();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool HistoryBuffer::Due(void)
+{
+	if (!IsOpen()) return 0;
+	if (++_frame < _decimation) return 0;
+	_frame = 0;
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void HistoryBuffer::Append(double time, const double *values)
+{
+	_time.Append(time);
+	for (int i=0; i<_num_signals; i++)
+		_signals[i].Append(values[i]);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+size_t HistoryBuffer::GetBytes(void)
+{
+	size_t bytes = _time.Bytes();
+	for (int i=0; i<_num_signals; i++)
+		bytes += _signals[i].Bytes();
+	return bytes;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -0,0 +1,98 @@
+#ifndef HISTORYBUFFER_HEADER_H
+#define HISTORYBUFFER_HEADER_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+using std::vector;
+
+/// One signal stored as XOR-compressed chunks of doubles
+/*
+	Each value is XORed with a prediction and only the meaningful bits of
+	the result are kept (Gorilla encoding, Pelkonen et al. 2015):
+		'0'                              same as predicted
+		'10' <bits>                      fits the previous leading/trailing zero window
+		'11' <5 bit lead> <6 bit len> <bits>  new window
+	The prediction is the previous value, or with delta prediction the
+	linear extrapolation 2*x[n-1] - x[n-2], which turns a fixed-step time
+	column into one bit per sample and is never worse for a constant.
+	Constant and piecewise constant signals (gear, flaps, set-running)
+	cost about one bit per sample; continuously varying states keep most
+	of their mantissa, 45 to 55 bits. Chunks of ChunkSize samples start
+	from a raw value, so they decode independently. Encoding is lossless;
+	the decoder repeats the same double arithmetic.
+*/
+class CompressedSeries
+{
+public:
+	enum {ChunkSize = 4096};
+
+	explicit CompressedSeries(bool delta_prediction = false);
+
+	void Append(double x);
+	void Clear(void);
+	size_t Size() const {return _size;}
+	/// Compressed size in bytes
+	size_t Bytes() const;
+	/// Decode count samples starting at first
+	void Decode(double *out, size_t first, size_t count) const;
+
+private:
+	struct Chunk
+	{
+		vector<uint64_t> words;
+		size_t nbits;
+		unsigned count;
+	};
+	static void Put(Chunk& chunk, uint64_t value, int n);
+	double Predict(unsigned count, double p1, double p2) const;
+
+	bool _delta;
+	size_t _size;
+	vector<Chunk> _chunks;
+	// encoder state of the last chunk
+	double _p1, _p2;
+	int _lead, _trail;
+};
+
+/// Decimated history of a fixed signal set, one compressed series per signal
+/*
+	Append() stores a frame [time values...]; Due() does the decimation
+	the same way TelemetryStreamer does, so that the caller only gathers
+	the frames that are kept. At 120 Hz an hour of a constant signal
+	takes 55 kB instead of 3.5 MB, a continuously varying one 2.5-3 MB.
+	All series use delta prediction.
+*/
+class HistoryBuffer
+{
+public:
+	HistoryBuffer(void);
+
+	/// Start an empty history; every decimation-th frame is kept
+	bool Open(int num_signals, int decimation);
+	void Close(void);
+	bool IsOpen(){return _num_signals > 0;}
+	/// Drop the recorded frames, keep the signal set
+	void Clear(void);
+
+	/// Counts the frame, true when it is to be appended
+	bool Due(void);
+	void Append(double time, const double *values);
+
+	int GetNumSignals(){return _num_signals;}
+	size_t GetLength(){return _time.Size();}
+	/// Compressed size, and the size of the same frames as plain doubles
+	size_t GetBytes(void);
+	size_t GetRawBytes(){return GetLength()*(_num_signals + 1)*sizeof(double);}
+
+	void DecodeTime(double *out){_time.Decode(out, 0, GetLength());}
+	void DecodeSignal(int i, double *out){_signals[i].Decode(out, 0, GetLength());}
+
+private:
+	int _num_signals, _decimation, _frame;
+	CompressedSeries _time;
+	vector<CompressedSeries> _signals;
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
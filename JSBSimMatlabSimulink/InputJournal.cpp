@@ -0,0 +1,278 @@
+#include "StdAfx.h"
+#include "InputJournal.h"
+#include <string.h>
+
+static const char JournalMagic[8] = {'J','S','B','J','R','N','L','1'};
+
+InputJournal::InputJournal(void)
+{
+	_file = 0L;
+	_recording = false;
+	_checkpoint_every = 0;
+	_steps = 0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+InputJournal::~InputJournal(void)
+{
+	Close();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool InputJournal::Create(const string file, const JournalHeader& header, int checkpoint_every)
+{
+	Close();
+	_file = fopen(file.c_str(), "wb");
+	if (!_file) return 0;
+	setvbuf(_file, 0L, _IOFBF, 1 << 16);
+	_recording = true;
+	_header = header;
+	_checkpoint_every = checkpoint_every < 0 ? 0 : checkpoint_every;
+
+	fwrite(JournalMagic, 1, sizeof(JournalMagic), _file);
+	PutDouble(header.dt);
+	PutDouble(header.multiplier);
+	PutString(header.aircraft);
+	fwrite(&header.aircraft_hash, sizeof(uint64_t), 1, _file);
+	PutVarint(_checkpoint_every);
+	PutVarint(header.input_names.size());
+	for (size_t i=0; i<header.input_names.size(); i++)
+	{
+		PutString(header.input_names[i]);
+		PutDouble(header.input_scales[i]);
+	}
+	PutVarint(header.stops.size());
+	for (size_t i=0; i<header.stops.size(); i++)
+		PutString(header.stops[i]);
+	return ferror(_file) == 0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool InputJournal::Load(const string file)
+{
+	Close();
+	_file = fopen(file.c_str(), "rb");
+	if (!_file) return 0;
+	setvbuf(_file, 0L, _IOFBF, 1 << 16);
+	_recording = false;
+	_header = JournalHeader();
+
+	char magic[sizeof(JournalMagic)];
+	uint64_t every = 0, n = 0;
+	bool ok = fread(magic, 1, sizeof(magic), _file) == sizeof(magic)
+		&& memcmp(magic, JournalMagic, sizeof(magic)) == 0
+		&& GetDouble(_header.dt) && GetDouble(_header.multiplier) && GetString(_header.aircraft)
+		&& fread(&_header.aircraft_hash, sizeof(uint64_t), 1, _file) == 1
+		&& GetVarint(every) && GetVarint(n);
+	for (uint64_t i=0; ok && i<n; i++)
+	{
+		string name;
+		double scale = 1.0;
+		ok = GetString(name) && GetDouble(scale);
+		_header.input_names.push_back(name);
+		_header.input_scales.push_back(scale);
+	}
+	ok = ok && GetVarint(n);
+	for (uint64_t i=0; ok && i<n; i++)
+	{
+		string stop;
+		ok = GetString(stop);
+		_header.stops.push_back(stop);
+	}
+	if (!ok)
+	{
+		Close();
+		return 0;
+	}
+	_checkpoint_every = (int)every;
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void InputJournal::Close(void)
+{
+	if (_file) fclose(_file);
+	_file = 0L;
+	_recording = false;
+	_steps = 0;
+	_last_inputs.clear();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void InputJournal::WriteInit(const vector<string>& names, const double *values)
+{
+	if (!IsRecording()) return;
+	fputc(eRecordInit, _file);
+	PutVarint(names.size());
+	for (size_t i=0; i<names.size(); i++)
+	{
+		PutString(names[i]);
+		PutDouble(values[i]);
+	}
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void InputJournal::WriteSet(const string name, double value)
+{
+	if (!IsRecording()) return;
+	fputc(eRecordSet, _file);
+	PutString(name);
+	PutDouble(value);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void InputJournal::WriteStep(const double *inputs, int width)
+{
+	if (!IsRecording()) return;
+	// compared bit for bit, so that a NaN input is written once as well
+	_changed.clear();
+	const bool first = (int)_last_inputs.size() != width;
+	for (int i=0; i<width; i++)
+		if (first || memcmp(&inputs[i], &_last_inputs[i], sizeof(double)) != 0)
+			_changed.push_back(i);
+	_last_inputs.assign(inputs, inputs + width);
+
+	fputc(eRecordStep, _file);
+	PutVarint(_changed.size());
+	for (size_t k=0; k<_changed.size(); k++)
+	{
+		PutVarint(_changed[k]);
+		PutDouble(inputs[_changed[k]]);
+	}
+	_steps++;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void InputJournal::WriteCheckpoint(uint64_t hash)
+{
+	if (!IsRecording()) return;
+	fputc(eRecordCheck, _file);
+	PutVarint(_steps);
+	fwrite(&hash, sizeof(uint64_t), 1, _file);
+	fflush(_file);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void InputJournal::WriteLoad(const string file, uint64_t hash)
+{
+	if (!IsRecording()) return;
+	fputc(eRecordLoad, _file);
+	PutString(file);
+	fwrite(&hash, sizeof(uint64_t), 1, _file);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+int InputJournal::Read(vector<string>& names, vector<double>& values, vector<double>& inputs,
+					   uint64_t& step, uint64_t& hash)
+{
+	if (!_file || _recording) return eRecordEnd;
+	if (inputs.empty())
+		inputs.assign(_header.input_names.empty() ? 8 : _header.input_names.size(), 0.0);
+
+	uint64_t n = 0, index = 0;
+	double value = 0.0;
+	string name;
+	switch (fgetc(_file))
+	{
+	case eRecordInit:
+		if (!GetVarint(n)) return eRecordEnd;
+		names.clear();
+		values.clear();
+		for (uint64_t i=0; i<n; i++)
+		{
+			if (!GetString(name) || !GetDouble(value)) return eRecordEnd;
+			names.push_back(name);
+			values.push_back(value);
+		}
+		return eRecordInit;
+	case eRecordSet:
+		if (!GetString(name) || !GetDouble(value)) return eRecordEnd;
+		names.assign(1, name);
+		values.assign(1, value);
+		return eRecordSet;
+	case eRecordStep:
+		if (!GetVarint(n)) return eRecordEnd;
+		for (uint64_t i=0; i<n; i++)
+		{
+			if (!GetVarint(index) || !GetDouble(value) || index >= inputs.size()) return eRecordEnd;
+			inputs[(size_t)index] = value;
+		}
+		_steps++;
+		return eRecordStep;
+	case eRecordCheck:
+		if (!GetVarint(step) || fread(&hash, sizeof(uint64_t), 1, _file) != 1) return eRecordEnd;
+		return eRecordCheck;
+	case eRecordLoad:
+		if (!GetString(name) || fread(&hash, sizeof(uint64_t), 1, _file) != 1) return eRecordEnd;
+		names.assign(1, name);
+		return eRecordLoad;
+	default:
+		return eRecordEnd;
+	}
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+uint64_t InputJournal::Hash(const double *values, int n, uint64_t hash)
+{
+	const unsigned char *bytes = (const unsigned char *)values;
+	for (size_t i=0; i<n*sizeof(double); i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+uint64_t InputJournal::HashFile(const string file)
+{
+	FILE *f = fopen(file.c_str(), "rb");
+	if (!f) return 0;
+	uint64_t hash = 14695981039346656037ULL;
+	unsigned char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		for (size_t i=0; i<n; i++)
+		{
+			hash ^= buf[i];
+			hash *= 1099511628211ULL;
+		}
+	fclose(f);
+	return hash;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void InputJournal::PutVarint(uint64_t x)
+{
+	while (x >= 0x80)
+	{
+		fputc((int)(x & 0x7F) | 0x80, _file);
+		x >>= 7;
+	}
+	fputc((int)x, _file);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void InputJournal::PutString(const string s)
+{
+	PutVarint(s.size());
+	fwrite(s.data(), 1, s.size(), _file);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void InputJournal::PutDouble(double x)
+{
+	fwrite(&x, sizeof(double), 1, _file);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool InputJournal::GetVarint(uint64_t& x)
+{
+	x = 0;
+	for (int shift=0; shift<64; shift+=7)
+	{
+		int c = fgetc(_file);
+		if (c == EOF) return 0;
+		x |= (uint64_t)(c & 0x7F) << shift;
+		if (!(c & 0x80)) return 1;
+	}
+	return 0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool InputJournal::GetString(string& s)
+{
+	uint64_t n;
+	if (!GetVarint(n) || n > (1 << 20)) return 0;
+	s.resize((size_t)n);
+	return n == 0 || fread(&s[0], 1, (size_t)n, _file) == n;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool InputJournal::GetDouble(double& x)
+{
+	return fread(&x, sizeof(double), 1, _file) == 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -0,0 +1,107 @@
+#ifndef INPUTJOURNAL_HEADER_H
+#define INPUTJOURNAL_HEADER_H
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+
+using std::string;
+using std::vector;
+
+/// What a journal replays against, written once at its start
+struct JournalHeader
+{
+	JournalHeader() : dt(0.0), multiplier(1.0), aircraft_hash(0) {}
+	double dt;
+	double multiplier;
+	string aircraft;
+	uint64_t aircraft_hash;			// of the aircraft file, 0 if it could not be read
+	vector<string> input_names;		// the signal map's inputs, empty for the 8 built-in controls
+	vector<double> input_scales;
+	vector<string> stops;
+};
+
+/// Binary journal of everything that drives a JSBSimInterface, for replay
+/*
+	The file holds the header followed by records, each starting with
+	one byte:
+		'I' <n> n * (<name> <value>)        Init(list, values)
+		'S' <name> <value>                  a property set between steps
+		'U' <n> n * (<index> <value>)       one UpdateStates call, only the
+		                                    inputs that changed since the last one
+		'C' <step> <hash>                   state hash after that many steps
+		'K' <file> <hash>                   a checkpoint loaded, with the hash of its file
+	Counts and indices are LEB128 varints, strings a varint length and
+	their bytes, numbers raw doubles and 64 bit words in the byte order
+	of the recording machine. A run holding its inputs costs two bytes a
+	step. The file is flushed at every checkpoint, so a run that crashed
+	still replays up to its last one.
+
+	Hash() is FNV-1a over the bits of the doubles: replaying with the
+	same binaries, aircraft and inputs has to give the same hash at every
+	checkpoint, and the first checkpoint that does not brackets the step
+	that diverged.
+*/
+class InputJournal
+{
+public:
+	enum JournalRecord {eRecordEnd=0, eRecordInit='I', eRecordSet='S', eRecordStep='U', eRecordCheck='C',
+		eRecordLoad='K'};
+
+	InputJournal(void);
+	~InputJournal(void);
+
+	/// Write a new journal, a checkpoint every checkpoint_every steps (0 = none)
+	bool Create(const string file, const JournalHeader& header, int checkpoint_every);
+	/// Read an existing journal, the header is available at once
+	bool Load(const string file);
+	void Close(void);
+	bool IsRecording(){return _file != 0L && _recording;}
+	bool IsOpen(){return _file != 0L;}
+	const JournalHeader& GetHeader(){return _header;}
+	/// Steps written or read so far
+	uint64_t GetSteps(){return _steps;}
+
+	void WriteInit(const vector<string>& names, const double *values);
+	void WriteSet(const string name, double value);
+	/// Counts the step, inputs holds width values
+	void WriteStep(const double *inputs, int width);
+	/// True after a step that is due for a checkpoint
+	bool CheckpointDue(){return _checkpoint_every > 0 && _steps > 0 && _steps % _checkpoint_every == 0;}
+	void WriteCheckpoint(uint64_t hash);
+	/// A checkpoint file loaded into the journaled instance, hash from HashFile
+	void WriteLoad(const string file, uint64_t hash);
+
+	/// Next record of a loaded journal, eRecordEnd at the end or on a damaged record
+	/*
+		eRecordInit fills names and values, eRecordSet names[0] and
+		values[0], eRecordStep updates inputs (which keeps its values
+		between steps and is sized to the header's input count, 8 for the
+		built-in controls), eRecordCheck step and hash, eRecordLoad names[0]
+		(the checkpoint file) and hash.
+	*/
+	int Read(vector<string>& names, vector<double>& values, vector<double>& inputs,
+			 uint64_t& step, uint64_t& hash);
+
+	static uint64_t Hash(const double *values, int n, uint64_t hash = 14695981039346656037ULL);
+	static uint64_t HashFile(const string file);
+
+private:
+	void PutVarint(uint64_t x);
+	void PutString(const string s);
+	void PutDouble(double x);
+	bool GetVarint(uint64_t& x);
+	bool GetString(string& s);
+	bool GetDouble(double& x);
+
+	FILE *_file;
+	bool _recording;
+	JournalHeader _header;
+	int _checkpoint_every;
+	uint64_t _steps;
+	vector<double> _last_inputs;
+	vector<int> _changed;
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
@@ -1,16 +1,27 @@
 #include "StdAfx.h"
 #include "JSBSimInterface.h"
 #include <models/FGAircraft.h>
+#include <models/FGAtmosphere.h>
+#include <models/FGMassBalance.h>
+#include <models/FGAerodynamics.h>
 #include <FGState.h>
 #include <math/FGQuaternion.h>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <string.h>
+#include <algorithm>
 
-JSBSimInterface::JSBSimInterface(FGFDMExec *fdmex, double dt)
+JSBSimInterface::JSBSimInterface(FGFDMExec *fdmex, double dt, bool announce)
 {
-	mexPrintf("JSBSimInterface is loading!\n");
+	if (announce)
+		mexPrintf("JSBSimInterface is loading!\n");
 	_ac_model_loaded = false;
 	fdmExec = fdmex;
+	dT = dt;
 	fdmExec->GetState()->Setdt(dt);
-	mexPrintf("Simulation dt set to %f\n",fdmExec->GetState()->Getdt());
+	if (announce)
+		mexPrintf("Simulation dt set to %f\n",fdmExec->GetState()->Getdt());
 	propagate = fdmExec->GetPropagate();
 	auxiliary = fdmExec->GetAuxiliary();
 	aerodynamics = fdmExec->GetAerodynamics();
@@ -18,8 +29,23 @@ JSBSimInterface::JSBSimInterface(FGFDMExec *fdmex, double dt)
 	fcs = fdmExec->GetFCS();
 	ic = new FGInitialCondition(fdmExec);
 	verbosityLevel = eSilent;
-	//catalog = fdmExec->GetPropertyCatalog();
-	catalog = fdmExec->SPrintPropertyCatalog();
+	x_times = 1;
+	_adaptive_tol = 0.0;
+	_adaptive_err = 0.0;
+	_adaptive_min = 1;
+	_adaptive_max = 100;
+	_adaptive_substeps = 0;
+	_output_groups = eAllOutputs;
+	_rt_factor = 0.0;
+	_spool_max_iter = 6000;
+	_spool_tol = 1.0e-4;
+	_spool_iterations = 0;
+	_stop_reason = 0;
+	_stop_time = 0.0;
+	_stepping = false;
+	// the catalog of an empty FDMExec, shared until an aircraft is loaded
+	_aircraft = AircraftCache::Acquire(fdmExec);
+	SetSnapshotNames(std::shared_ptr<const vector<string> >(_aircraft, &_aircraft->properties));
 }
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 JSBSimInterface::~JSBSimInterface(void)
@@ -74,10 +100,16 @@ bool JSBSimInterface::Open(string prop)
 		return 0;
     }
 	_ac_model_loaded = true;
+	_aircraft = AircraftCache::Acquire(fdmExec);
+	SetSnapshotNames(std::shared_ptr<const vector<string> >(_aircraft, &_aircraft->properties));
 	// Print AC name
 	if ( verbosityLevel == eVerbose )
 		mexPrintf("\tModel %s loaded.\n", fdmExec->GetModelName().c_str() );
 
+	// resolve the signal map to property nodes once, the step loop only reads them
+	if ( !ResolveSignalMap() )
+		return 0;
+
 //***********************************************************************
 	// populate aircraft catalog
 	   fdmExec->PrintPropertyCatalog();
@@ -128,6 +160,8 @@ bool JSBSimInterface::SetPropertyValue(const mxArray *prhs1, const mxArray *prhs
 	string prop = "";
 	prop = string(buf);
 	double value = *mxGetPr(prhs2);
+	if (!_stepping)
+		_journal.WriteSet(prop, value);
 
 	if (!EasySetValue(prop,value)) // first check if an easy way of setting is implemented
 	{
@@ -330,12 +364,8 @@ bool JSBSimInterface::EasySetValue(const string prop,  double value)
 			fdmExec->GetFCS()->SetThrottleCmd(i, value);//control the throttle cmd
 			fdmExec->GetFCS()->SetThrottlePos(i, value);//control the throttle position
 		}
-		//ensure that the engines have spooled up completely
-		for(unsigned i=0;i<2000;i++){
-			fdmExec->GetFCS()->Run();
-			propagate->Run();
-			auxiliary->Run();
-		}
+		//the engines are spooled up to this setting by SpoolUpEngines() at the end of Init
+		fdmExec->GetFCS()->Run();
 		if ( verbosityLevel == eVerbose )
 			mexPrintf("\tEasy-set: throttle pos norm (for all throttles) = %f\n",fdmExec->GetFCS()->GetThrottlePos(1));
 		return 1;
@@ -393,25 +423,84 @@ bool JSBSimInterface::EasySetValue(const string prop,  double value)
 
 		return 1;
 	}
+	//JSBSim time step of this instance, e.g. for a larger dt with a higher order integrator
+	else if (prop == "delta-t")
+	{
+		return SetDeltaT(value);
+	}
+	//Adaptive multiplier, a tolerance > 0 switches it on
+	else if (prop == "adaptive/tolerance")
+	{
+		SetAdaptiveMultiplier(value, _adaptive_min, _adaptive_max);
+		return 1;
+	}
+	else if (prop == "adaptive/min-substeps")
+	{
+		SetAdaptiveMultiplier(_adaptive_tol, (int)value, _adaptive_max);
+		return 1;
+	}
+	else if (prop == "adaptive/max-substeps")
+	{
+		SetAdaptiveMultiplier(_adaptive_tol, _adaptive_min, (int)value);
+		return 1;
+	}
+	//Engine pre-conditioning done by Init, 0 iterations switches it off
+	else if (prop == "spool-up/max-iterations")
+	{
+		_spool_max_iter = (value < 0) ? 0 : (int)value;
+		return 1;
+	}
+	else if (prop == "spool-up/tolerance")
+	{
+		_spool_tol = value;
+		return 1;
+	}
+	//Real-time pacing, "realtime/factor" = 1 runs one frame per dT*multiplier of wall clock time
+	else if (prop == "realtime/factor")
+	{
+		_rt_factor = (value < 0) ? 0 : value;
+		_pacer.Reset();
+		return 1;
+	}
+	else if (prop == "realtime/cpu")
+	{
+		_pacer.SetCPU((int)value);
+		return 1;
+	}
+	else if (prop == "realtime/priority")
+	{
+		_pacer.SetPriority((int)value);
+		return 1;
+	}
+	else if (prop == "realtime/spin-us")
+	{
+		_pacer.SetSpinTime(value*1.0e-6);
+		return 1;
+	}
+	//Execution schedule, "rate/propulsion" = 4 runs the propulsion model every 4th frame
+	else if (prop.compare(0, 5, "rate/") == 0)
+	{
+		return SetModelRate(prop.substr(5), (int)value);
+	}
+	//Integrator selection, "integrator/rate/rotational" maps to "simulation/integrator/rate/rotational"
+	else if (prop.compare(0, 11, "integrator/") == 0)
+	{
+		return SetIntegrator(prop.substr(11), (int)value);
+	}
 	
 	return 0;
 }
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 bool JSBSimInterface::QueryJSBSimProperty(string prop)
 {
-	// mexPrintf("catalog size: %d\n",catalog.size());
-	for (unsigned i=0; i<catalog.size(); i++)
-	{
-		// mexPrintf("__%s__\n",catalog[i].c_str());
-		if (catalog[i]==prop) return 1;
-	}
-	return 0;
+	// the shared catalog is sorted
+	return std::binary_search(_aircraft->catalog.begin(), _aircraft->catalog.end(), prop);
 }
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 void JSBSimInterface::PrintCatalog()
 {
 	//catalog = fdmExec->GetPropertyCatalog();
-	catalog = fdmExec->SPrintPropertyCatalog();
+	vector<string> catalog = fdmExec->SPrintPropertyCatalog();
 		mexPrintf("-- Property catalog for current aircraft %s:\n",fdmExec->GetModelName().c_str());
 		for (unsigned i=0; i<catalog.size(); i++)
 			mexPrintf("%s\n",catalog[i].c_str());
@@ -426,6 +515,7 @@ bool JSBSimInterface::ResetToInitialCondition()
 	fdmExec->GetState()->Setsim_time(0.0);
 	fdmExec->ResetToInitialConditions();
 	fdmExec->GetIC()->ResetIC(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	_stop_reason = 0;
 	mexPrintf("Aircraft states are reset to IC\n");
 	return 1;
 }
@@ -583,6 +673,90 @@ bool JSBSimInterface::Init(const mxArray *prhs1)
     mxFree(classIDflags);
 	mxFree((void *)fnames);
 
+	return FinishInit(success);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::ResolveInitList(const vector<string>& names, JIInitList& list)
+{
+	static const char *states[] = {"u-fps", "v-fps", "w-fps", "p-rad_sec", "q-rad_sec", "r-rad_sec",
+		"h-sl-ft", "long-gc-deg", "lat-gc-deg", "phi-rad", "theta-rad", "psi-rad"};
+
+	list.names = names;
+	list.setters.resize(names.size());
+	list.nodes.assign(names.size(), (FGPropertyManager*)0L);
+	for (unsigned i=0; i<names.size(); i++)
+	{
+		int k;
+		for (k=0; k<12; k++)
+			if (names[i] == states[k]) break;
+		if (k < 12)
+			list.setters[i] = eSetU + k;
+		else if (names[i] != "fcs/throttle-cmd-norm" &&
+				 (list.nodes[i] = fdmExec->GetPropertyManager()->GetNode(names[i])) != 0L)
+			list.setters[i] = eSetNode;
+		else
+			list.setters[i] = eSetEasy; // internal properties and the easy-set shortcuts
+	}
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::Init(const JIInitList& list, const double *values)
+{
+	_journal.WriteInit(list.names, values);
+
+	// Set dt=0 first
+	fdmExec->GetState()->SuspendIntegration();
+
+	bool attitude = false;
+	double euler[3] = {propagate->GetEuler(1), propagate->GetEuler(2), propagate->GetEuler(3)};
+
+	for (unsigned i=0; i<list.setters.size(); i++)
+	{
+		const double value = values[i];
+		switch (list.setters[i])
+		{
+		case eSetU: case eSetV: case eSetW:
+			propagate->SetUVW(list.setters[i] - eSetU + 1, value);
+			break;
+		case eSetP: case eSetQ: case eSetR:
+			propagate->SetPQR(list.setters[i] - eSetP + 1, value);
+			break;
+		case eSetH:		propagate->Seth(value); break;
+		case eSetLong:	propagate->SetLongitudeDeg(value); break;
+		case eSetLat:	propagate->SetLatitudeDeg(value); break;
+		case eSetPhi: case eSetTheta: case eSetPsi:
+			euler[list.setters[i] - eSetPhi] = value;
+			attitude = true;
+			break;
+		case eSetNode:
+			list.nodes[i]->setDoubleValue(value);
+			break;
+		default:
+			// like SetPropertyValue, names that are neither easy-set nor in the catalog are skipped
+			if (!EasySetValue(list.names[i], value) && verbosityLevel == eDebug)
+				mexPrintf("\tERROR: JSBSim could not find the property '%s' in the aircraft catalog.\n",list.names[i].c_str());
+		}
+	}
+
+	// the attitude as one quaternion, then one run for the derived values
+	if (attitude)
+	{
+		FGQuaternion Quat( euler[0], euler[1], euler[2] );
+		Quat.Normalize();
+		FGPropagate::VehicleState vstate = propagate->GetVState();
+		vstate.vQtrn = Quat;
+		propagate->SetVState(vstate);
+	}
+	propagate->Run();
+	auxiliary->Run();
+	if ( verbosityLevel == eVerbose )
+		mexPrintf("\tNumeric init: %d values set, Vt = %f (ft/s)\n",(int)list.setters.size(),auxiliary->GetVt());
+
+	return FinishInit(1);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::FinishInit(bool success)
+{
 	//---------------------------------------------------------------
 	// see "FGInitialConditions.h"
 	// NOTE:
@@ -603,173 +777,1388 @@ bool JSBSimInterface::Init(const mxArray *prhs1)
 	fdmExec->GetPropagate()->CalculateQuatdot();     // Angular orientation derivative
 	fdmExec->GetPropagate()->CalculateLocationdot(); // Translational position derivative
 
-	_udot = propagate->GetUVWdot(1);
-	_vdot = propagate->GetUVWdot(2);
-	_wdot = propagate->GetUVWdot(3);
-	_pdot = propagate->GetPQRdot(1);
-	_qdot = propagate->GetPQRdot(2);
-	_rdot = propagate->GetPQRdot(3);
+	_udot = propagate->GetUVWdot(1);
+	_vdot = propagate->GetUVWdot(2);
+	_wdot = propagate->GetUVWdot(3);
+	_pdot = propagate->GetPQRdot(1);
+	_qdot = propagate->GetPQRdot(2);
+	_rdot = propagate->GetPQRdot(3);
+
+	// a new run, the stop conditions are armed again and the statistics restart
+	_stop_reason = 0;
+	_stop_time = 0.0;
+	for (unsigned i=0; i<_statistics.size(); i++)
+		_statistics[i].stats.Reset();
+	_history.Clear();
+
+	// bring the engines to the commanded power before the first step
+	if (_spool_max_iter > 0)
+		SpoolUpEngines(_spool_max_iter, _spool_tol);
+
+	if ( verbosityLevel == eVerbose ){
+		//fdmExec->GetState()->Setdt(1.0/120);
+		mexPrintf(" Initial State derivatives calculated at:\n");
+		mexPrintf("\t Simulation dt %f\n",fdmExec->GetState()->Getdt());
+		mexPrintf("\t Simulation sim-time %f\n",fdmExec->GetSimTime());		
+		mexPrintf("\t[u_dot, v_dot, w_dot] = [%f, %f, %f] (ft/s/s)\n",
+			propagate->GetUVWdot(1),propagate->GetUVWdot(2),propagate->GetUVWdot(3));
+		mexPrintf("\t[p_dot, q_dot, r_dot] = [%f, %f, %f] (rad/s/s)\n",
+			propagate->GetPQRdot(1),propagate->GetPQRdot(2),propagate->GetPQRdot(3));
+	}
+	
+		fdmExec->Run();
+		fdmExec->GetState()->ResumeIntegration();
+		fdmExec->GetState()->Setdt(dT); // a "delta-t" set during Init takes effect here
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("Simulation dt set to %f\n",fdmExec->GetState()->Getdt());
+		
+		if ( verbosityLevel == eVerbose ){
+		//JSBSim generated states prior to integration
+		mexPrintf("\t Initial State variables calculated.\n");
+		mexPrintf("\tU %f (ft/s)\n",fdmExec->GetPropagate()->GetUVW(1));
+		mexPrintf("\tV %f (ft/s)\n",fdmExec->GetPropagate()->GetUVW(2));
+		mexPrintf("\tW %f (ft/s)\n",fdmExec->GetPropagate()->GetUVW(3));
+		mexPrintf("\tP %f (rad/s)\n",fdmExec->GetPropagate()->GetPQR(1));
+		mexPrintf("\tQ %f (rad/s)\n",fdmExec->GetPropagate()->GetPQR(2));
+		mexPrintf("\tR %f (rad/s)\n",fdmExec->GetPropagate()->GetPQR(3));
+		mexPrintf("\tH %f (ft)\n",fdmExec->GetPropagate()->Geth());
+		mexPrintf("\tPhi %f (rad)\n",fdmExec->GetPropagate()->GetEuler(1));
+		mexPrintf("\tTheta %f (rad)\n",fdmExec->GetPropagate()->GetEuler(2));
+		mexPrintf("\tPsi %f (rad)\n",fdmExec->GetPropagate()->GetEuler(3));
+		}
+
+	if (!success)
+	{
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("\tERROR: One or more or all the required properties could not be initialized.\n");
+		return 0;
+	}
+	else
+		return 1;
+}
+/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::GetEngNum(real_T *num_of_eng)
+{
+
+	mexPrintf("\JSBSim: engine(s) running = %i\n",fdmExec->GetPropulsion()->GetNumEngines());
+	
+	return 1;
+
+
+	if (!Init(prhs1))
+	{
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("\tERROR: could not calculate dotted states correctly.\n");
+		return 0;
+	}
+	statedot[ 0] = _udot;
+	statedot[ 1] = _vdot;
+	statedot[ 2] = _wdot;
+	statedot[ 3] = _pdot;
+	statedot[ 4] = _qdot;
+	statedot[ 5] = _rdot;
+	statedot[ 6] = _q1dot;
+	statedot[ 7] = _q2dot;
+	statedot[ 8] = _q3dot;
+	statedot[ 9] = _q4dot;
+	statedot[10] = _xdot;
+	statedot[11] = _ydot;
+	statedot[12] = _zdot;
+	statedot[13] = _phidot;
+	statedot[14] = _thetadot;
+	statedot[15] = _psidot;
+	statedot[16] = _hdot;
+	statedot[17] = _alphadot;
+	statedot[18] = _betadot;
+
+	return 1;
+	
+}
+
+
+bool JSBSimInterface::GetEngType(string* engtype)
+{
+	//string engine = (string) fdmExec->GetPropulsion()->GetEngine(0)->GetType();
+	return 1;
+}
+*/
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::SetVerbosity(const mxArray *prhs1)
+{
+	int field; // field index (0)
+	mwIndex    jstruct;	// index (0)
+	mxArray *tmp; // mxArray pointer
+
+	//mexPrintf("SetVerbosity called.\n");
+
+	if (!fdmExec) return 0;
+	// if (!IsAircraftLoaded()) return 0;
+	// even when aircraft is null we must be able to set verbosity level
+	jstruct = 0;
+	field = 0;
+
+	tmp = mxGetFieldByNumber(prhs1,jstruct,field); //point to field number 0
+
+	if ( mxIsChar(tmp) )
+	{
+		char buf[128];
+		mwSize buflen;
+		buflen = mxGetNumberOfElements(tmp) + 1;
+		mxGetString(tmp, buf, buflen);
+		string prop = "";
+		prop = string(buf);
+		//mexPrintf("Verbosity level set.\n");
+		if ( (prop == "silent") ||
+			 (prop == "Silent") ||
+			 (prop == "SILENT")
+			)
+		{
+			SetVerbosity( (JIVerbosityLevel)0 );
+		}
+		else if ( (prop == "verbose") ||
+			      (prop == "Verbose") ||
+			      (prop == "VERBOSE")
+			)
+		{
+			SetVerbosity( (JIVerbosityLevel)1 );
+		}
+		else if ( (prop == "very verbose") ||
+			      (prop == "Very Verbose") ||
+			      (prop == "VERY VERBOSE")
+			)
+		{
+			SetVerbosity( (JIVerbosityLevel)2 );
+		}
+		else if ( (prop == "debug") ||
+			      (prop == "Debug") ||
+			      (prop == "DEBUG")
+			)
+		{
+			SetVerbosity( (JIVerbosityLevel)3 );
+		}
+		else 
+			return 0;
+	}
+	else if ( mxIsNumeric(prhs1) )
+	{
+		double value = 0;
+		value = *mxGetPr(prhs1);
+		//mexPrintf("%f Verbosity level set in JII.\n", value);
+		int ival = (int) value;
+		if (ival <= eVeryVerbose)
+		{
+			SetVerbosity( (JIVerbosityLevel)ival );
+		}
+		else
+			return 0;
+	}
+	
+	return 1;
+}
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::SetIntegrators(int rot_rate, int trans_rate, int rot_pos, int trans_pos)
+{
+	bool success = 1;
+	success = SetIntegrator("rate/rotational", rot_rate) && success;
+	success = SetIntegrator("rate/translational", trans_rate) && success;
+	success = SetIntegrator("position/rotational", rot_pos) && success;
+	success = SetIntegrator("position/translational", trans_pos) && success;
+	return success;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::SetIntegrator(const string which, int type)
+{
+	if (!fdmExec) return 0;
+
+	if ( (which != "rate/rotational")     && (which != "rate/translational") &&
+		 (which != "position/rotational") && (which != "position/translational") )
+	{
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("\tERROR: unknown integrator '%s'.\n",which.c_str());
+		return 0;
+	}
+	if ( (type < eIntNone) || (type > eIntAdamsBashforth4) )
+	{
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("\tERROR: integrator type %d is not in the range %d..%d.\n",type,eIntNone,eIntAdamsBashforth4);
+		return 0;
+	}
+	// the property is tied to FGPropagate::integrator_*, so it takes effect on the next Run()
+	fdmExec->SetPropertyValue("simulation/integrator/" + which, (double)type);
+	if ( verbosityLevel == eVerbose )
+		mexPrintf("\tEasy-set: %s integrator = %d\n",which.c_str(),type);
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::SetDeltaT(double dt)
+{
+	if (!fdmExec) return 0;
+	if (dt <= 0.0)
+	{
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("\tERROR: dt must be positive (got %f).\n",dt);
+		return 0;
+	}
+	dT = dt;
+	// while Init() holds integration suspended (dt=0) only remember the value,
+	// Init() applies it when integration is resumed
+	if (fdmExec->GetState()->Getdt() != 0.0)
+		fdmExec->GetState()->Setdt(dt);
+	if ( verbosityLevel == eVerbose )
+		mexPrintf("\tEasy-set: simulation dt = %f\n",dT);
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+/// Scale factor of a signal map unit, either a plain number or a unit name
+static bool LookupUnit(const string unit, double& scale)
+{
+	static const struct { const char *name; double scale; } units[] = {
+		{"deg", 57.295779513082323}, {"rad", 0.017453292519943295},
+		{"kts", 0.59248380129589628}, {"mps", 0.3048}, {"fpm", 60.0},
+		{"m", 0.3048}, {"ft", 3.2808398950131235} };
+
+	char *end = 0;
+	scale = strtod(unit.c_str(), &end);
+	if (end != unit.c_str() && *end == '\0') return 1;
+	for (unsigned u=0; u<sizeof(units)/sizeof(units[0]); u++)
+		if (unit == units[u].name)
+		{
+			scale = units[u].scale;
+			return 1;
+		}
+	return 0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::ReadSignalMap(const string file, JISignalMap& map, string& error)
+{
+	std::ifstream in(file.c_str());
+	if (!in)
+	{
+		error = "cannot open signal map '" + file + "'";
+		return 0;
+	}
+
+	string line;
+	int lineno = 0;
+	while (std::getline(in, line))
+	{
+		lineno++;
+		size_t hash = line.find('#');
+		if (hash != string::npos) line.erase(hash);
+
+		std::istringstream fields(line);
+		string kind, prop, unit;
+		if (!(fields >> kind)) continue; // empty or comment line
+
+		std::ostringstream where;
+		where << file << ":" << lineno << ": ";
+
+		if (kind == "output")
+		{
+			int port = -1;
+			if (!(fields >> port >> prop) || port < eFCSPort || port > eCalculatedPort)
+			{
+				error = where.str() + "expected 'output <1..3> <property> [unit]'";
+				return 0;
+			}
+			double scale = 1.0;
+			if (fields >> unit && !LookupUnit(unit, scale))
+			{
+				error = where.str() + "unknown unit '" + unit + "'";
+				return 0;
+			}
+			map.outputs[port].names.push_back(prop);
+			map.outputs[port].scales.push_back(scale);
+		}
+		else if (kind == "input")
+		{
+			if (!(fields >> prop))
+			{
+				error = where.str() + "expected 'input <property> [unit]'";
+				return 0;
+			}
+			double scale = 1.0;
+			if (fields >> unit && !LookupUnit(unit, scale))
+			{
+				error = where.str() + "unknown unit '" + unit + "'";
+				return 0;
+			}
+			map.inputs.names.push_back(prop);
+			map.inputs.scales.push_back(scale);
+		}
+		else if (kind == "stream")
+		{
+			if (!(fields >> prop))
+			{
+				error = where.str() + "expected 'stream <property> [unit]'";
+				return 0;
+			}
+			double scale = 1.0;
+			if (fields >> unit && !LookupUnit(unit, scale))
+			{
+				error = where.str() + "unknown unit '" + unit + "'";
+				return 0;
+			}
+			map.stream.names.push_back(prop);
+			map.stream.scales.push_back(scale);
+		}
+		else if (kind == "stream-to")
+		{
+			if (!(fields >> map.stream_to))
+			{
+				error = where.str() + "expected 'stream-to udp:<host>:<port>' or 'stream-to unix:<path>'";
+				return 0;
+			}
+		}
+		else if (kind == "stream-every")
+		{
+			if (!(fields >> map.stream_every) || map.stream_every < 1)
+			{
+				error = where.str() + "expected 'stream-every <n>', n >= 1";
+				return 0;
+			}
+		}
+		else if (kind == "stream-delta")
+		{
+			int delta;
+			if (!(fields >> delta))
+			{
+				error = where.str() + "expected 'stream-delta <0|1>'";
+				return 0;
+			}
+			map.stream_delta = (delta != 0);
+		}
+		else if (kind == "record")
+		{
+			if (!(fields >> prop))
+			{
+				error = where.str() + "expected 'record <property> [unit]'";
+				return 0;
+			}
+			double scale = 1.0;
+			if (fields >> unit && !LookupUnit(unit, scale))
+			{
+				error = where.str() + "unknown unit '" + unit + "'";
+				return 0;
+			}
+			map.record.names.push_back(prop);
+			map.record.scales.push_back(scale);
+		}
+		else if (kind == "record-every")
+		{
+			if (!(fields >> map.record_every) || map.record_every < 1)
+			{
+				error = where.str() + "expected 'record-every <n>', n >= 1";
+				return 0;
+			}
+		}
+		else if (kind == "mat-file")
+		{
+			if (!(fields >> map.mat_file))
+			{
+				error = where.str() + "expected 'mat-file <file>'";
+				return 0;
+			}
+		}
+		else if (kind == "stop")
+		{
+			string spec, rest;
+			std::getline(fields, spec);
+			int op;
+			double threshold;
+			if (!ParseStopCondition(spec, rest, op, threshold))
+			{
+				error = where.str() + "expected 'stop <property> <op> <value>' or 'stop nan'";
+				return 0;
+			}
+			map.stops.push_back(spec);
+		}
+		else if (kind == "stat")
+		{
+			string spec, rest;
+			std::getline(fields, spec);
+			SignalStats stats;
+			if (!ParseStatistic(spec, rest, stats))
+			{
+				error = where.str() + "expected 'stat <property> [q <p>...] [> <x> | < <x>]'";
+				return 0;
+			}
+			map.stats.push_back(spec);
+		}
+		else
+		{
+			error = where.str() + "unknown entry '" + kind + "'";
+			return 0;
+		}
+	}
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::SetSignalMap(const JISignalMap& map)
+{
+	_signal_map = map;
+	for (int port=0; port<eNumOutputPorts; port++)
+		_signal_map.outputs[port].nodes.clear();
+	_signal_map.inputs.nodes.clear();
+	_signal_map.inputs.index.clear();
+	_signal_map.stream.nodes.clear();
+	_signal_map.record.nodes.clear();
+	_streamer.Close();
+	_history.Close();
+	if (IsAircraftLoaded())
+		return ResolveSignalMap();
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::ResolveSignalMap(void)
+{
+	for (int port=0; port<eNumOutputPorts; port++)
+	{
+		JISignalList& list = _signal_map.outputs[port];
+		list.nodes.resize(list.names.size());
+		for (unsigned i=0; i<list.names.size(); i++)
+		{
+			list.nodes[i] = fdmExec->GetPropertyManager()->GetNode(list.names[i]);
+			if (!list.nodes[i])
+			{
+				if ( verbosityLevel == eVerbose )
+					mexPrintf("\tERROR: signal map property '%s' (port %d) is not in the aircraft catalog.\n",
+						list.names[i].c_str(),port);
+				list.nodes.clear();
+				return 0;
+			}
+		}
+	}
+
+	// inputs: expand the per-engine fan-out, then resolve every target once
+	JISignalList& in = _signal_map.inputs;
+	in.nodes.clear();
+	in.index.clear();
+	int engines = (int) fdmExec->GetPropulsion()->GetNumEngines();
+	for (unsigned i=0; i<in.names.size(); i++)
+	{
+		vector<string> targets;
+		size_t star = in.names[i].find("[*]");
+		if (star == string::npos)
+			targets.push_back(in.names[i]);
+		else
+			for (int e=0; e<engines; e++)
+			{
+				std::ostringstream name;
+				name << in.names[i].substr(0,star) << "[" << e << "]" << in.names[i].substr(star+3);
+				targets.push_back(name.str());
+			}
+
+		for (unsigned t=0; t<targets.size(); t++)
+		{
+			FGPropertyManager* node = fdmExec->GetPropertyManager()->GetNode(targets[t]);
+			if (!node)
+			{
+				if ( verbosityLevel == eVerbose )
+					mexPrintf("\tERROR: signal map input '%s' is not in the aircraft catalog.\n",
+						targets[t].c_str());
+				in.nodes.clear();
+				in.index.clear();
+				return 0;
+			}
+			in.nodes.push_back(node);
+			in.index.push_back(i);
+		}
+	}
+
+	// telemetry: resolve the streamed properties and open the socket
+	JISignalList& st = _signal_map.stream;
+	st.nodes.resize(st.names.size());
+	for (unsigned i=0; i<st.names.size(); i++)
+	{
+		st.nodes[i] = fdmExec->GetPropertyManager()->GetNode(st.names[i]);
+		if (!st.nodes[i])
+		{
+			if ( verbosityLevel == eVerbose )
+				mexPrintf("\tERROR: streamed property '%s' is not in the aircraft catalog.\n",
+					st.names[i].c_str());
+			st.nodes.clear();
+			return 0;
+		}
+	}
+	if (!ResolveRecordList())
+		return 0;
+
+	// stop conditions of the map replace the current ones
+	if (!_signal_map.stops.empty())
+	{
+		ClearStopConditions();
+		for (unsigned i=0; i<_signal_map.stops.size(); i++)
+			if (!AddStopCondition(_signal_map.stops[i]))
+			{
+				if ( verbosityLevel == eVerbose )
+					mexPrintf("\tERROR: stop condition '%s' cannot be resolved.\n",
+						_signal_map.stops[i].c_str());
+				return 0;
+			}
+	}
+
+	if (!_signal_map.stats.empty())
+	{
+		ClearStatistics();
+		for (unsigned i=0; i<_signal_map.stats.size(); i++)
+			if (!AddStatistic(_signal_map.stats[i]))
+			{
+				if ( verbosityLevel == eVerbose )
+					mexPrintf("\tERROR: statistic '%s' cannot be resolved.\n",
+						_signal_map.stats[i].c_str());
+				return 0;
+			}
+	}
+
+	if (!st.nodes.empty() && !_signal_map.stream_to.empty())
+	{
+		_stream_values.resize(st.nodes.size());
+		if (!_streamer.Open(_signal_map.stream_to, (int)st.nodes.size(),
+				_signal_map.stream_every, _signal_map.stream_delta))
+		{
+			if ( verbosityLevel == eVerbose )
+				mexPrintf("\tERROR: telemetry to '%s' could not be opened.\n",
+					_signal_map.stream_to.c_str());
+			return 0;
+		}
+	}
+
+	if (!_signal_map.mat_file.empty() && !OpenMatFile(_signal_map.mat_file))
+		return 0;
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimInterface::GatherSignals(const JISignalList& list, double *ptr)
+{
+	const size_t n = list.nodes.size();
+	for (size_t i=0; i<n; i++)
+		ptr[i] = list.nodes[i]->getDoubleValue() * list.scales[i];
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimInterface::ScatterSignals(const JISignalList& list, const double *ptr)
+{
+	const size_t n = list.nodes.size();
+	for (size_t i=0; i<n; i++)
+		list.nodes[i]->setDoubleValue(ptr[list.index[i]] * list.scales[list.index[i]]);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::ParseStopCondition(const string spec, string& prop, int& op, double& threshold)
+{
+	static const char *ops[] = {">", ">=", "<", "<=", "==", "!="};
+	std::istringstream fields(spec);
+	string cmp, extra;
+	if (!(fields >> prop)) return 0;
+	if (prop == "nan")
+	{
+		op = eStopNaN;
+		threshold = 0.0;
+		return !(fields >> extra);
+	}
+	if (!(fields >> cmp >> threshold) || fields >> extra) return 0;
+	for (op=eStopGreater; op<eStopNaN; op++)
+		if (cmp == ops[op]) return 1;
+	return 0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+int JSBSimInterface::AddStopCondition(const string spec)
+{
+	JIStopCondition c;
+	string prop;
+	if (!IsAircraftLoaded() || !ParseStopCondition(spec, prop, c.op, c.threshold)) return 0;
+	c.spec = spec.substr(spec.find_first_not_of(" \t"));
+	c.node = 0L;
+	if (c.op != eStopNaN)
+	{
+		c.node = fdmExec->GetPropertyManager()->GetNode(prop);
+		if (!c.node) return 0;
+	}
+	_stops.push_back(c);
+	return (int)_stops.size();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+static bool IsNaN(double x){return x != x;}
+
+bool JSBSimInterface::CheckStopConditions(void)
+{
+	if (_stop_reason) return 1;
+	for (unsigned i=0; i<_stops.size(); i++)
+	{
+		const JIStopCondition& c = _stops[i];
+		bool hit = false;
+		if (c.op == eStopNaN)
+		{
+			for (int k=1; k<=3; k++)
+				hit = hit || IsNaN(propagate->GetUVW(k)) || IsNaN(propagate->GetPQR(k))
+					|| IsNaN(propagate->GetEuler(k));
+			hit = hit || IsNaN(propagate->Geth()) || IsNaN(propagate->GetLongitudeDeg())
+				|| IsNaN(propagate->GetLatitudeDeg());
+		}
+		else
+		{
+			double value = c.node->getDoubleValue();
+			switch (c.op)
+			{
+			case eStopGreater:      hit = value >  c.threshold; break;
+			case eStopGreaterEqual: hit = value >= c.threshold; break;
+			case eStopLess:         hit = value <  c.threshold; break;
+			case eStopLessEqual:    hit = value <= c.threshold; break;
+			case eStopEqual:        hit = value == c.threshold; break;
+			case eStopNotEqual:     hit = value != c.threshold; break;
+			}
+		}
+		if (hit)
+		{
+			_stop_reason = i + 1;
+			_stop_time = fdmExec->GetSimTime(); // no output here, this may run off the Matlab thread
+			return 1;
+		}
+	}
+	return 0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::ParseStatistic(const string spec, string& prop, SignalStats& stats)
+{
+	std::istringstream fields(spec);
+	string word;
+	if (!(fields >> prop)) return 0;
+	while (fields >> word)
+	{
+		double value;
+		if (word == "q")
+		{
+			int n = 0;
+			while (fields >> value)
+			{
+				if (value < 0.0 || value > 1.0) return 0;
+				stats.AddQuantile(value);
+				n++;
+			}
+			if (n == 0) return 0;
+			fields.clear(); // the next keyword stopped the numbers
+		}
+		else if ((word == ">" || word == "<") && !stats.HasThreshold() && fields >> value)
+			stats.SetThreshold(value, word == ">");
+		else
+			return 0;
+	}
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+int JSBSimInterface::AddStatistic(const string spec)
+{
+	JIStatistic s;
+	string prop;
+	if (!IsAircraftLoaded() || !ParseStatistic(spec, prop, s.stats)) return 0;
+	s.node = fdmExec->GetPropertyManager()->GetNode(prop);
+	if (!s.node) return 0;
+	s.spec = spec.substr(spec.find_first_not_of(" \t"));
+	_statistics.push_back(s);
+	return (int)_statistics.size();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimInterface::UpdateStatistics(void)
+{
+	if (_statistics.empty()) return;
+	const double t = fdmExec->GetSimTime();
+	for (unsigned i=0; i<_statistics.size(); i++)
+		_statistics[i].stats.Add(t, _statistics[i].node->getDoubleValue());
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::SetRecordList(const vector<string>& names, int every)
+{
+	_signal_map.record = JISignalList();
+	_signal_map.record.names = names;
+	_signal_map.record.scales.assign(names.size(), 1.0);
+	_signal_map.record_every = every < 1 ? 1 : every;
+	_history.Close();
+	if (IsAircraftLoaded())
+		return ResolveRecordList();
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::ResolveRecordList(void)
+{
+	JISignalList& rec = _signal_map.record;
+	rec.nodes.resize(rec.names.size());
+	for (unsigned i=0; i<rec.names.size(); i++)
+	{
+		rec.nodes[i] = fdmExec->GetPropertyManager()->GetNode(rec.names[i]);
+		if (!rec.nodes[i])
+		{
+			if ( verbosityLevel == eVerbose )
+				mexPrintf("\tERROR: recorded property '%s' is not in the aircraft catalog.\n",
+					rec.names[i].c_str());
+			rec.nodes.clear();
+			return 0;
+		}
+	}
+	_history.Close();
+	if (!rec.nodes.empty())
+	{
+		_record_values.resize(rec.nodes.size());
+		_history.Open((int)rec.nodes.size(), _signal_map.record_every);
+	}
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::OpenMatFile(const string file)
+{
+	static const char *variables[eNumOutputPorts] = {"states", "fcs", "propulsion", "calculated"};
+	if (!IsAircraftLoaded()) return 0;
+	if (!_mat.Open(file))
+	{
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("\tERROR: MAT-file '%s' could not be created.\n",file.c_str());
+		return 0;
+	}
+	for (int port=0; port<eNumOutputPorts; port++)
+	{
+		vector<string> names;
+		GetOutputNames(_signal_map, port, names);
+		_mat_vars[port] = _mat.AddVariable(variables[port], "sim-time", names);
+		if (_mat_vars[port] < 0)
+		{
+			if ( verbosityLevel == eVerbose )
+				mexPrintf("\tERROR: the part files of MAT-file '%s' could not be created.\n",file.c_str());
+			_mat.Close();
+			return 0;
+		}
+	}
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::CloseMatFile(void)
+{
+	return _mat.Close();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimInterface::WriteMatFrame(const double *x_ptr, const double *fc_ptr, const double *p_ptr, const double *c_ptr)
+{
+	const double t = fdmExec->GetSimTime();
+	_mat.Append(_mat_vars[eStatePort], t, x_ptr);
+	if (_output_groups & eFCSOutputs)
+		_mat.Append(_mat_vars[eFCSPort], t, fc_ptr);
+	if (_output_groups & ePropulsionOutputs)
+		_mat.Append(_mat_vars[ePropulsionPort], t, p_ptr);
+	if (_output_groups & eCalculatedOutputs)
+		_mat.Append(_mat_vars[eCalculatedPort], t, c_ptr);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::StartJournal(const string file, int checkpoint_every)
+{
+	if (!IsAircraftLoaded()) return 0;
+	JournalHeader header;
+	header.dt = dT;
+	header.multiplier = GetMultiplier();
+	header.aircraft = fdmExec->GetModelName();
+	header.aircraft_hash = _aircraft->file_hash;
+	header.input_names = _signal_map.inputs.names;
+	header.input_scales = _signal_map.inputs.scales;
+	for (unsigned i=0; i<_stops.size(); i++)
+		header.stops.push_back(_stops[i].spec);
+	if (!_journal.Create(file, header, checkpoint_every))
+	{
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("\tERROR: journal '%s' could not be created.\n",file.c_str());
+		return 0;
+	}
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+uint64_t JSBSimInterface::StateHash(const double *x_ptr)
+{
+	double t = fdmExec->GetSimTime();
+	return InputJournal::Hash(x_ptr, 12, InputJournal::Hash(&t, 1));
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::ReplayJournal(const string file, JIReplayReport& report)
+{
+	report = JIReplayReport();
+	InputJournal journal;
+	if (!journal.Load(file))
+	{
+		report.error = "the journal cannot be read";
+		return 0;
+	}
+	const JournalHeader& header = journal.GetHeader();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// a fresh instance, driven the way the recorded one was
+	FGFDMExec *exec = new FGFDMExec();
+	JSBSimInterface *ji = new JSBSimInterface(exec, header.dt, false);
+	ji->SetVerbosity(eSilent);
+	JISignalMap map;
+	map.inputs.names = header.input_names;
+	map.inputs.scales = header.input_scales;
+	map.stops = header.stops;
+	ji->SetSignalMap(map);
+	ji->SetMultiplier(header.multiplier);
+	report.loaded = ji->Open(header.aircraft);
+	if (!report.loaded)
+		report.error = "aircraft '" + header.aircraft + "' cannot be loaded";
+	else
+	{
+		report.aircraft_changed = header.aircraft_hash != 0 && ji->GetAircraftData().file_hash != header.aircraft_hash;
+		ji->SetOutputGroups(0);		// outputs do not feed back into the states
+		vector<double> x(12), fc(GetOutputWidth(map, eFCSPort)), p(GetOutputWidth(map, ePropulsionPort)),
+			c(GetOutputWidth(map, eCalculatedPort));
+		vector<string> names;
+		vector<double> values, inputs;
+		uint64_t step = 0, hash = 0;
+		int record;
+		while ((record = journal.Read(names, values, inputs, step, hash)) != InputJournal::eRecordEnd)
+		{
+			if (record == InputJournal::eRecordInit)
+			{
+				// pacing is not replayed
+				vector<string> init_names;
+				vector<double> init_values;
+				for (unsigned i=0; i<names.size(); i++)
+					if (names[i].compare(0, 9, "realtime/") != 0)
+					{
+						init_names.push_back(names[i]);
+						init_values.push_back(values[i]);
+					}
+				JIInitList list;
+				ji->ResolveInitList(init_names, list);
+				ji->Init(list, init_values.empty() ? 0L : &init_values[0]);
+			}
+			else if (record == InputJournal::eRecordSet)
+				ji->SetPropertyValue(names[0], values[0]);
+			else if (record == InputJournal::eRecordStep)
+				ji->UpdateStates(&inputs[0], &x[0], &fc[0], &p[0], &c[0]);
+			else if (record == InputJournal::eRecordLoad)
+			{
+				// the warm start is repeated from the same file, which must not have changed
+				if (InputJournal::HashFile(names[0]) != hash)
+				{
+					report.error = "checkpoint '" + names[0] + "' is missing or changed since the recording";
+					break;
+				}
+				if (!ji->LoadCheckpoint(names[0]))
+				{
+					report.error = "checkpoint '" + names[0] + "' cannot be loaded";
+					break;
+				}
+			}
+			else if (record == InputJournal::eRecordCheck)
+			{
+				if (step != journal.GetSteps() || hash != ji->StateHash(&x[0]))
+				{
+					report.diverged_step = (int64_t)step;
+					break;
+				}
+				report.checkpoints++;
+				report.last_good_step = (int64_t)step;
+			}
+		}
+		report.steps = journal.GetSteps();
+		report.sim_time = exec->GetSimTime();
+	}
+	delete ji;
+	delete exec;
+	report.wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return report.loaded && report.diverged_step < 0 && report.error.empty();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+static const char CheckpointMagic[8] = {'J','S','B','S','I','M','C','K'};
+static const uint32_t CheckpointVersion = 1;
+
+static void WriteValue(std::ostream& out, const void *data, size_t n)
+{
+	out.write((const char *)data, n);
+}
+
+static void WriteString(std::ostream& out, const string s)
+{
+	uint32_t n = (uint32_t)s.size();
+	WriteValue(out, &n, sizeof(n));
+	out.write(s.data(), n);
+}
+
+static void WriteVector(std::ostream& out, const vector<double>& v)
+{
+	uint32_t n = (uint32_t)v.size();
+	WriteValue(out, &n, sizeof(n));
+	if (n) WriteValue(out, &v[0], n*sizeof(double));
+}
+
+static bool ReadValue(std::istream& in, void *data, size_t n)
+{
+	return (bool)in.read((char *)data, n);
+}
+
+static bool ReadString(std::istream& in, string& s)
+{
+	uint32_t n;
+	if (!ReadValue(in, &n, sizeof(n)) || n > (1 << 20)) return 0;
+	s.resize(n);
+	return n == 0 || ReadValue(in, &s[0], n);
+}
+
+static bool ReadVector(std::istream& in, vector<double>& v)
+{
+	uint32_t n;
+	if (!ReadValue(in, &n, sizeof(n)) || n > (1 << 20)) return 0;
+	v.resize(n);
+	return n == 0 || ReadValue(in, &v[0], n*sizeof(double));
+}
 
-	if ( verbosityLevel == eVerbose ){
-		//fdmExec->GetState()->Setdt(1.0/120);
-		mexPrintf(" Initial State derivatives calculated at:\n");
-		mexPrintf("\t Simulation dt %f\n",fdmExec->GetState()->Getdt());
-		mexPrintf("\t Simulation sim-time %f\n",fdmExec->GetSimTime());		
-		mexPrintf("\t[u_dot, v_dot, w_dot] = [%f, %f, %f] (ft/s/s)\n",
-			propagate->GetUVWdot(1),propagate->GetUVWdot(2),propagate->GetUVWdot(3));
-		mexPrintf("\t[p_dot, q_dot, r_dot] = [%f, %f, %f] (rad/s/s)\n",
-			propagate->GetPQRdot(1),propagate->GetPQRdot(2),propagate->GetPQRdot(3));
+void JSBSimInterface::SetSnapshotNames(const std::shared_ptr<const vector<string> >& names)
+{
+	_snapshot_names = names;
+	_snapshot_nodes.clear();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimInterface::ResolveSnapshotNodes(void)
+{
+	// a name missing in this instance, or read-only here, is skipped
+	_snapshot_nodes.resize(_snapshot_names->size());
+	for (unsigned i=0; i<_snapshot_nodes.size(); i++)
+	{
+		_snapshot_nodes[i] = fdmExec->GetPropertyManager()->GetNode((*_snapshot_names)[i]);
+		if (_snapshot_nodes[i] && !_snapshot_nodes[i]->getAttribute(SGPropertyNode::WRITE))
+			_snapshot_nodes[i] = 0L;
 	}
-	
-		fdmExec->Run();
-		fdmExec->GetState()->ResumeIntegration();
-		if ( verbosityLevel == eVerbose )
-			mexPrintf("Simulation dt set to %f\n",fdmExec->GetState()->Getdt());
-		
-		if ( verbosityLevel == eVerbose ){
-		//JSBSim generated states prior to integration
-		mexPrintf("\t Initial State variables calculated.\n");
-		mexPrintf("\tU %f (ft/s)\n",fdmExec->GetPropagate()->GetUVW(1));
-		mexPrintf("\tV %f (ft/s)\n",fdmExec->GetPropagate()->GetUVW(2));
-		mexPrintf("\tW %f (ft/s)\n",fdmExec->GetPropagate()->GetUVW(3));
-		mexPrintf("\tP %f (rad/s)\n",fdmExec->GetPropagate()->GetPQR(1));
-		mexPrintf("\tQ %f (rad/s)\n",fdmExec->GetPropagate()->GetPQR(2));
-		mexPrintf("\tR %f (rad/s)\n",fdmExec->GetPropagate()->GetPQR(3));
-		mexPrintf("\tH %f (ft)\n",fdmExec->GetPropagate()->Geth());
-		mexPrintf("\tPhi %f (rad)\n",fdmExec->GetPropagate()->GetEuler(1));
-		mexPrintf("\tTheta %f (rad)\n",fdmExec->GetPropagate()->GetEuler(2));
-		mexPrintf("\tPsi %f (rad)\n",fdmExec->GetPropagate()->GetEuler(3));
-		}
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimInterface::TakeSnapshot(JISnapshot& snap, bool rescan)
+{
+	if (rescan)
+	{
+		std::shared_ptr<vector<string> > names(new vector<string>);
+		vector<FGPropertyManager*> nodes;
+		AircraftCache::CollectProperties(fdmExec->GetPropertyManager(), "", *names, nodes);
+		// the shared list is kept while nothing was added
+		if (*names != *_snapshot_names)
+			_snapshot_names = names;
+		_snapshot_nodes.swap(nodes);
+	}
+	else if (_snapshot_nodes.size() != _snapshot_names->size())
+		ResolveSnapshotNodes();
+	snap.sim_time = fdmExec->GetSimTime();
+	const FGPropagate::VehicleState& vstate = propagate->GetVState();
+	for (int i=0; i<3; i++)
+	{
+		snap.state[i] = vstate.vLocation(i+1);
+		snap.state[3+i] = vstate.vUVW(i+1);
+		snap.state[6+i] = vstate.vPQR(i+1);
+	}
+	for (int i=0; i<4; i++)
+		snap.state[9+i] = vstate.vQtrn(i+1);
+
+	snap.tanks.resize(propulsion->GetNumTanks());
+	for (unsigned i=0; i<snap.tanks.size(); i++)
+		snap.tanks[i] = propulsion->GetTank(i)->GetContents();
+	snap.rpm.resize(propulsion->GetNumEngines());
+	for (unsigned i=0; i<snap.rpm.size(); i++)
+		snap.rpm[i] = propulsion->GetEngine(i)->GetThruster()->GetRPM();
+
+	snap.names = _snapshot_names;
+	snap.values.resize(_snapshot_nodes.size());
+	for (unsigned i=0; i<_snapshot_nodes.size(); i++)
+		snap.values[i] = _snapshot_nodes[i] ? _snapshot_nodes[i]->getDoubleValue() : 0.0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::RestoreSnapshot(const JISnapshot& snap)
+{
+	if (snap.tanks.size() != propulsion->GetNumTanks() || snap.rpm.size() != propulsion->GetNumEngines()
+		|| !snap.names || snap.values.size() != snap.names->size())
+		return 0;
+	// resolved again only when the property list changes; a snapshot of
+	// another instance of the aircraft holds the same shared list
+	if (snap.names != _snapshot_names && *snap.names != *_snapshot_names)
+		SetSnapshotNames(snap.names);
+	if (_snapshot_nodes.size() != _snapshot_names->size())
+		ResolveSnapshotNodes();
 
-	if (!success)
+	fdmExec->GetState()->SuspendIntegration();
+	// past derivatives and FCS states of whatever ran before are dropped
+	propagate->InitModel();
+	fcs->InitModel();
+	for (unsigned i=0; i<_snapshot_nodes.size(); i++)
+		if (_snapshot_nodes[i])
+			_snapshot_nodes[i]->setDoubleValue(snap.values[i]);
+	for (unsigned i=0; i<snap.tanks.size(); i++)
+		propulsion->GetTank(i)->SetContents(snap.tanks[i]);
+	for (unsigned i=0; i<snap.rpm.size(); i++)
+		propulsion->GetEngine(i)->GetThruster()->SetRPM(snap.rpm[i]);
+	fdmExec->GetState()->Setsim_time(snap.sim_time);
+
+	// the vehicle state last, setters such as position/h-sl-ft above moved it
+	FGPropagate::VehicleState vstate = propagate->GetVState();
+	for (int i=0; i<3; i++)
+	{
+		vstate.vLocation(i+1) = snap.state[i];
+		vstate.vUVW(i+1) = snap.state[3+i];
+		vstate.vPQR(i+1) = snap.state[6+i];
+	}
+	for (int i=0; i<4; i++)
+		vstate.vQtrn(i+1) = snap.state[9+i];
+	propagate->SetVState(vstate);
+	propagate->Run();
+	auxiliary->Run();
+
+	// the engines are where the snapshot left them, no spool-up
+	int spool_max_iter = _spool_max_iter;
+	_spool_max_iter = 0;
+	bool result = FinishInit(1);
+	_spool_max_iter = spool_max_iter;
+	return result;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::SaveCheckpoint(const string file)
+{
+	if (!IsAircraftLoaded()) return 0;
+	std::ofstream out(file.c_str(), std::ios::binary);
+	if (!out)
 	{
 		if ( verbosityLevel == eVerbose )
-			mexPrintf("\tERROR: One or more or all the required properties could not be initialized.\n");
+			mexPrintf("\tERROR: checkpoint '%s' could not be created.\n",file.c_str());
 		return 0;
 	}
-	else
-		return 1;
+	JISnapshot snap;
+	TakeSnapshot(snap, true);
+
+	// what the checkpoint is valid for
+	const string aircraft = fdmExec->GetModelName();
+	uint64_t aircraft_hash = _aircraft->file_hash;
+	WriteValue(out, CheckpointMagic, sizeof(CheckpointMagic));
+	WriteValue(out, &CheckpointVersion, sizeof(CheckpointVersion));
+	WriteString(out, aircraft);
+	WriteValue(out, &aircraft_hash, sizeof(aircraft_hash));
+	WriteValue(out, &dT, sizeof(dT));
+
+	WriteValue(out, &snap.sim_time, sizeof(snap.sim_time));
+	WriteValue(out, snap.state, sizeof(snap.state));
+	WriteVector(out, snap.tanks);
+	WriteVector(out, snap.rpm);
+	uint32_t n = (uint32_t)snap.names->size();
+	WriteValue(out, &n, sizeof(n));
+	for (uint32_t i=0; i<n; i++)
+		WriteString(out, (*snap.names)[i]);
+	WriteVector(out, snap.values);
+
+	out.close();
+	if (!out)
+	{
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("\tERROR: checkpoint '%s' could not be written.\n",file.c_str());
+		return 0;
+	}
+	if ( verbosityLevel == eVerbose )
+		mexPrintf("\tCheckpoint at sim-time %f s written to '%s' (%d properties).\n",
+			snap.sim_time,file.c_str(),(int)n);
+	return 1;
 }
-/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-bool JSBSimInterface::GetEngNum(real_T *num_of_eng)
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::LoadCheckpoint(const string file)
 {
-
-	mexPrintf("\JSBSim: engine(s) running = %i\n",fdmExec->GetPropulsion()->GetNumEngines());
-	
-	return 1;
-
-
-	if (!Init(prhs1))
+	if (!IsAircraftLoaded()) return 0;
+	std::ifstream in(file.c_str(), std::ios::binary);
+	char magic[sizeof(CheckpointMagic)];
+	uint32_t version = 0;
+	string aircraft;
+	uint64_t aircraft_hash = 0;
+	double dt = 0.0;
+	if (!in || !ReadValue(in, magic, sizeof(magic)) || memcmp(magic, CheckpointMagic, sizeof(magic)) != 0
+		|| !ReadValue(in, &version, sizeof(version)) || version != CheckpointVersion)
 	{
 		if ( verbosityLevel == eVerbose )
-			mexPrintf("\tERROR: could not calculate dotted states correctly.\n");
+			mexPrintf("\tERROR: '%s' is not a version %d checkpoint.\n",file.c_str(),(int)CheckpointVersion);
+		return 0;
+	}
+	if (!ReadString(in, aircraft) || !ReadValue(in, &aircraft_hash, sizeof(aircraft_hash))
+		|| !ReadValue(in, &dt, sizeof(dt)) || aircraft != fdmExec->GetModelName() || dt != dT
+		|| aircraft_hash != _aircraft->file_hash)
+	{
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("\tERROR: checkpoint '%s' was saved for aircraft '%s' at dt %f, not for the loaded one.\n",
+				file.c_str(),aircraft.c_str(),dt);
 		return 0;
 	}
-	statedot[ 0] = _udot;
-	statedot[ 1] = _vdot;
-	statedot[ 2] = _wdot;
-	statedot[ 3] = _pdot;
-	statedot[ 4] = _qdot;
-	statedot[ 5] = _rdot;
-	statedot[ 6] = _q1dot;
-	statedot[ 7] = _q2dot;
-	statedot[ 8] = _q3dot;
-	statedot[ 9] = _q4dot;
-	statedot[10] = _xdot;
-	statedot[11] = _ydot;
-	statedot[12] = _zdot;
-	statedot[13] = _phidot;
-	statedot[14] = _thetadot;
-	statedot[15] = _psidot;
-	statedot[16] = _hdot;
-	statedot[17] = _alphadot;
-	statedot[18] = _betadot;
 
+	// read everything before anything is set, a damaged file leaves the state as it was
+	JISnapshot snap;
+	uint32_t n = 0;
+	bool ok = ReadValue(in, &snap.sim_time, sizeof(snap.sim_time)) && ReadValue(in, snap.state, sizeof(snap.state))
+		&& ReadVector(in, snap.tanks) && ReadVector(in, snap.rpm) && ReadValue(in, &n, sizeof(n)) && n <= (1 << 20);
+	std::shared_ptr<vector<string> > names(new vector<string>(ok ? n : 0));
+	for (uint32_t i=0; ok && i<n; i++)
+		ok = ReadString(in, (*names)[i]);
+	snap.names = names;
+	ok = ok && ReadVector(in, snap.values) && RestoreSnapshot(snap);
+	if (!ok)
+	{
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("\tERROR: checkpoint '%s' is damaged or does not match the aircraft's engines and tanks.\n",
+				file.c_str());
+		return 0;
+	}
+	_journal.WriteLoad(file, InputJournal::HashFile(file));
+	if ( verbosityLevel == eVerbose )
+		mexPrintf("\tCheckpoint '%s' loaded: sim-time %f s, %d properties.\n",file.c_str(),snap.sim_time,(int)n);
 	return 1;
-	
 }
-
-
-bool JSBSimInterface::GetEngType(string* engtype)
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::StepFDMExec(void)
 {
-	//string engine = (string) fdmExec->GetPropulsion()->GetEngine(0)->GetType();
+	bool result = fdmExec->Run();
+	if (_history.Due())
+	{
+		GatherSignals(_signal_map.record, &_record_values[0]);
+		_history.Append(fdmExec->GetSimTime(), &_record_values[0]);
+	}
+	UpdateStatistics();
+	CheckStopConditions();
+	return result;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimInterface::GetOutputNames(const JISignalMap& map, int port, vector<string>& names)
+{
+	static const char *states[] = {
+		"velocities/u-fps", "velocities/v-fps", "velocities/w-fps",
+		"velocities/p-rad_sec", "velocities/q-rad_sec", "velocities/r-rad_sec",
+		"position/h-sl-ft", "position/long-gc-deg", "position/lat-gc-deg",
+		"attitude/phi-rad", "attitude/theta-rad", "attitude/psi-rad" };
+	static const char *fcs_outputs[] = {
+		"fcs/throttle-pos-norm", "fcs/left-aileron-pos-rad", "fcs/elevator-pos-rad",
+		"fcs/tvc-pos-rad", "fcs/rudder-pos-rad", "fcs/flap-pos-norm",
+		"fcs/right-aileron-pos-rad", "fcs/speedbrake-pos-rad", "fcs/spoiler-pos-rad",
+		"fcs/lef-pos-rad", "gear/gear-pos-norm", "fcs/steer-pos-deg", "gear/unit/WOW" };
+	static const char *calculated[] = {
+		"accelerations/Nz", "aero/alpha-rad", "aero/alphadot-rad_sec", "aero/beta-rad",
+		"aero/betadot-rad_sec", "velocities/vc-fps", "velocities/vc-kts", "velocities/vt-fps",
+		"velocities/vg-fps", "velocities/mach", "velocities/h-dot-fps" };
+
+	names.clear();
+	if (port < 0 || port >= eNumOutputPorts) return;
+	if (port != eStatePort && !map.outputs[port].names.empty())
+	{
+		names = map.outputs[port].names;
+		return;
+	}
+	switch (port)
+	{
+	case eStatePort:		names.assign(states, states + 12); break;
+	case eFCSPort:			names.assign(fcs_outputs, fcs_outputs + 13); break;
+	case eCalculatedPort:	names.assign(calculated, calculated + 11); break;
+	default:
+		// per engine, the layout depends on the engine type
+		for (int i=0; i<GetOutputWidth(map, port); i++)
+		{
+			std::ostringstream name;
+			name << "propulsion/output[" << i << "]";
+			names.push_back(name.str());
+		}
+	}
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+int JSBSimInterface::GetInputWidth(const JISignalMap& map)
+{
+	return map.inputs.names.empty() ? 8 : (int)map.inputs.names.size();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+int JSBSimInterface::GetOutputWidth(const JISignalMap& map, int port)
+{
+	static const int builtin[eNumOutputPorts] = {12, 13, 48, 11};
+	if (port < 0 || port >= eNumOutputPorts) return 0;
+	if (port != eStatePort && !map.outputs[port].names.empty())
+		return (int)map.outputs[port].names.size();
+	return builtin[port];
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+FGModel* JSBSimInterface::GetScheduledModel(const string model)
+{
+	if (!fdmExec) return 0L;
+
+	if (model == "propulsion")		return fdmExec->GetPropulsion();
+	if (model == "atmosphere")		return fdmExec->GetAtmosphere();
+	if (model == "auxiliary")		return fdmExec->GetAuxiliary();
+	if (model == "aerodynamics")	return fdmExec->GetAerodynamics();
+	if (model == "massbalance")		return fdmExec->GetMassBalance();
+	return 0L;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::SetModelRate(const string model, int rate)
+{
+	FGModel *m = GetScheduledModel(model);
+	if (!m)
+	{
+		if ( verbosityLevel == eVerbose )
+			mexPrintf("\tERROR: the '%s' model can not be scheduled at a divided rate.\n",model.c_str());
+		return 0;
+	}
+	if (rate < 1) rate = 1;
+	m->SetRate(rate);
+	if ( verbosityLevel == eVerbose )
+		mexPrintf("\tEasy-set: %s model runs every %d frame(s)\n",model.c_str(),rate);
 	return 1;
 }
-*/
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-bool JSBSimInterface::SetVerbosity(const mxArray *prhs1)
+int JSBSimInterface::GetModelRate(const string model)
 {
-	int field; // field index (0)
-	mwIndex    jstruct;	// index (0)
-	mxArray *tmp; // mxArray pointer
-
-	//mexPrintf("SetVerbosity called.\n");
+	FGModel *m = GetScheduledModel(model);
+	return m ? m->GetRate() : 0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimInterface::CopySchedule(JSBSimInterface& other)
+{
+	static const char *models[] = {"propulsion", "atmosphere", "auxiliary", "aerodynamics", "massbalance"};
+	for (unsigned i=0; i<sizeof(models)/sizeof(models[0]); i++)
+		SetModelRate(models[i], other.GetModelRate(models[i]));
+	SetMultiplier(other.GetMultiplier());
+	SetAdaptiveMultiplier(other._adaptive_tol, other._adaptive_min, other._adaptive_max);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+int JSBSimInterface::SpoolUpEngines(int max_iter, double tol)
+{
+	if (!fdmExec) return -1;
 
-	if (!fdmExec) return 0;
-	// if (!IsAircraftLoaded()) return 0;
-	// even when aircraft is null we must be able to set verbosity level
-	jstruct = 0;
-	field = 0;
+	unsigned engines = propulsion->GetNumEngines();
+	if (engines == 0) return 0;
 
-	tmp = mxGetFieldByNumber(prhs1,jstruct,field); //point to field number 0
+	// per engine: thrust, thruster rpm, n1, n2 (the latter only exist for turbines)
+	vector<FGPropertyManager*> n1(engines), n2(engines);
+	vector<double> last(4*engines, 0.0);
+	for (unsigned i=0; i<engines; i++)
+	{
+		char name[64];
+		sprintf(name, "propulsion/engine[%u]/n1", i);
+		n1[i] = fdmExec->GetPropertyManager()->GetNode(name);
+		sprintf(name, "propulsion/engine[%u]/n2", i);
+		n2[i] = fdmExec->GetPropertyManager()->GetNode(name);
+	}
 
-	if ( mxIsChar(tmp) )
+	// Init() holds dt at zero; engine dynamics need the real step. Propulsion
+	// must also run every iteration, whatever its schedule.
+	double saved_dt = fdmExec->GetState()->Getdt();
+	int saved_rate = propulsion->GetRate();
+	bool saved_trim = fdmExec->GetTrimStatus();
+	fdmExec->GetState()->Setdt(dT);
+	propulsion->SetRate(1);
+	fdmExec->SetTrimStatus(true); // no fuel burn while spooling up
+
+	const int settle = 10;
+	int steady_count = 0;
+	int iter = 0;
+	while (iter < max_iter && steady_count < settle)
 	{
-		char buf[128];
-		mwSize buflen;
-		buflen = mxGetNumberOfElements(tmp) + 1;
-		mxGetString(tmp, buf, buflen);
-		string prop = "";
-		prop = string(buf);
-		//mexPrintf("Verbosity level set.\n");
-		if ( (prop == "silent") ||
-			 (prop == "Silent") ||
-			 (prop == "SILENT")
-			)
-		{
-			SetVerbosity( (JIVerbosityLevel)0 );
-		}
-		else if ( (prop == "verbose") ||
-			      (prop == "Verbose") ||
-			      (prop == "VERBOSE")
-			)
-		{
-			SetVerbosity( (JIVerbosityLevel)1 );
-		}
-		else if ( (prop == "very verbose") ||
-			      (prop == "Very Verbose") ||
-			      (prop == "VERY VERBOSE")
-			)
-		{
-			SetVerbosity( (JIVerbosityLevel)2 );
-		}
-		else if ( (prop == "debug") ||
-			      (prop == "Debug") ||
-			      (prop == "DEBUG")
-			)
+		fcs->Run();
+		propulsion->Run();
+		iter++;
+
+		bool steady = true;
+		for (unsigned i=0; i<engines; i++)
 		{
-			SetVerbosity( (JIVerbosityLevel)3 );
+			FGEngine *eng = propulsion->GetEngine(i);
+			double now[4];
+			now[0] = eng->GetThrust();
+			now[1] = eng->GetThruster()->GetRPM();
+			now[2] = n1[i] ? n1[i]->getDoubleValue() : 0.0;
+			now[3] = n2[i] ? n2[i]->getDoubleValue() : 0.0;
+			for (int k=0; k<4; k++)
+			{
+				double ref = fabs(now[k]) > 1.0 ? fabs(now[k]) : 1.0;
+				if (fabs(now[k] - last[4*i+k]) > tol*ref) steady = false;
+				last[4*i+k] = now[k];
+			}
 		}
-		else 
-			return 0;
+		steady_count = steady ? steady_count + 1 : 0;
 	}
-	else if ( mxIsNumeric(prhs1) )
+
+	fdmExec->SetTrimStatus(saved_trim);
+	propulsion->SetRate(saved_rate);
+	fdmExec->GetState()->Setdt(saved_dt);
+
+	_spool_iterations = iter;
+	if ( verbosityLevel == eVerbose )
 	{
-		double value = 0;
-		value = *mxGetPr(prhs1);
-		//mexPrintf("%f Verbosity level set in JII.\n", value);
-		int ival = (int) value;
-		if (ival <= eVeryVerbose)
-		{
-			SetVerbosity( (JIVerbosityLevel)ival );
-		}
+		if (steady_count >= settle)
+			mexPrintf("\tEngines spooled up in %d iterations (%f s of engine time).\n",iter,iter*dT);
 		else
-			return 0;
+			mexPrintf("\tWARNING: engines not steady after %d iterations.\n",iter);
+	}
+	return (steady_count >= settle) ? iter : -1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimInterface::SetAdaptiveMultiplier(double tol, int min_sub, int max_sub)
+{
+	_adaptive_tol = tol;
+	_adaptive_min = (min_sub < 1) ? 1 : min_sub;
+	_adaptive_max = (max_sub < _adaptive_min) ? _adaptive_min : max_sub;
+	_adaptive_substeps = 0; // restart from the fixed multiplier on the next frame
+	if ( verbosityLevel == eVerbose )
+	{
+		if (IsAdaptive())
+			mexPrintf("\tEasy-set: adaptive multiplier, tolerance %g, %d..%d substeps per frame\n",
+				_adaptive_tol,_adaptive_min,_adaptive_max);
+		else
+			mexPrintf("\tEasy-set: fixed multiplier %f\n",GetMultiplier());
 	}
-	
-	return 1;
 }
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimInterface::RunAdaptive(void)
+{
+	// the frame length is fixed by Simulink, only its subdivision changes
+	double frame = dT * GetMultiplier();
+	int n = _adaptive_substeps;
+	if (n == 0) n = (int)GetMultiplier();
+	if (n < _adaptive_min) n = _adaptive_min;
+	if (n > _adaptive_max) n = _adaptive_max;
+
+	double h = frame / n;
+	fdmExec->GetState()->Setdt(h);
+
+	double acc[6], acc_prev[6];
+	for (int k=0; k<3; k++)
+	{
+		acc_prev[k]   = propagate->GetUVWdot(k+1);
+		acc_prev[k+3] = propagate->GetPQRdot(k+1);
+	}
 
+	bool result = true;
+	double err = 0.0;
+	for (int i=0; i<n; i++)
+	{
+		result = StepFDMExec() && result;
+		if (IsStopped()) break;
+
+		double vel = sqrt(propagate->GetUVW(1)*propagate->GetUVW(1) +
+						  propagate->GetUVW(2)*propagate->GetUVW(2) +
+						  propagate->GetUVW(3)*propagate->GetUVW(3));
+		if (vel < 1.0) vel = 1.0;
+		for (int k=0; k<3; k++)
+		{
+			acc[k]   = propagate->GetUVWdot(k+1);
+			acc[k+3] = propagate->GetPQRdot(k+1);
+			double e_uvw = 0.5*h*fabs(acc[k]   - acc_prev[k])   / vel;
+			double e_pqr = 0.5*h*fabs(acc[k+3] - acc_prev[k+3]);
+			if (e_uvw > err) err = e_uvw;
+			if (e_pqr > err) err = e_pqr;
+		}
+		for (int k=0; k<6; k++) acc_prev[k] = acc[k];
+	}
+	fdmExec->GetState()->Setdt(dT);
+
+	// choose the subdivision of the next frame; factors of two keep the
+	// multistep integrators close to their constant dt assumption
+	int used = n;
+	if (err > _adaptive_tol && n < _adaptive_max)
+		n = (2*n > _adaptive_max) ? _adaptive_max : 2*n;
+	else if (err < 0.125*_adaptive_tol && n > _adaptive_min)
+		n = (n/2 < _adaptive_min) ? _adaptive_min : n/2;
+
+	if ( verbosityLevel == eDebug )
+		mexPrintf("\tAdaptive multiplier: error %g, %d substeps used, %d next\n",err,used,n);
+
+	_adaptive_err = err;
+	_adaptive_substeps = n;
+	return result;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 double JSBSimInterface::GetEulerDot(int i)
 {
 	double angle;
@@ -820,26 +2209,40 @@ bool JSBSimInterface::UpdateStates(double *u_ptr, double *x_ptr, double *fc_ptr,
 	/* Receive updated control inputs from MexJSBSimSFun, propagate them through one JSBSim cycle
 	 * and retrieve updated states and outputs, and return them to MexJSBSimSFunction.
 	 */
+	_stepping = true;
+	if (_journal.IsRecording())
+		_journal.WriteStep(u_ptr, GetInputWidth(_signal_map));
 
 	   /* New control inputs from S-Function 
 		* Control Input Vector = [throttle aileron elevator rudder mixture set-run flaps gear]
+		* unless the signal map declares its own inputs
 		*/
+		if (!_signal_map.inputs.nodes.empty())
+			ScatterSignals(_signal_map.inputs, u_ptr);
+		else
+		{
 		for(unsigned i=0;i<fdmExec->GetPropulsion()->GetNumEngines();i++)
 			fdmExec->GetFCS()->SetThrottleCmd(i, u_ptr[0]);//control the throttle(s)
 		fdmExec->GetFCS()->SetDaCmd(u_ptr[1]);//control the ailerons
 		fdmExec->GetFCS()->SetDeCmd(u_ptr[2]);//control the elevators
 		fdmExec->GetFCS()->SetDrCmd(u_ptr[3]);//control the rudder(s)
-		SetPropertyValue("fcs/mixture-cmd-norm",u_ptr[4]);//control the mixture
+		for(unsigned i=0;i<fdmExec->GetPropulsion()->GetNumEngines();i++)
+			fdmExec->GetFCS()->SetMixtureCmd(i, u_ptr[4]);//control the mixture(s)
 		for(unsigned i=0;i<fdmExec->GetPropulsion()->GetNumEngines();i++)
 			fdmExec->GetPropulsion()->GetEngine(i)->SetRunning(u_ptr[5]);//set engine(s) to running
 		fdmExec->GetFCS()->SetDfCmd(u_ptr[6]);//control the flaps
 		fdmExec->GetFCS()->SetGearCmd(u_ptr[7]);//control the gear position
+		}
 
 		
 
-		//Run JSBSim x times
-		for(int i = 0;i < GetMultiplier();i++){
-			fdmExec->Run();
+		//Run JSBSim x times, or as many substeps as the error estimate asks for
+		//Once a stop condition holds the state is held
+		if (IsAdaptive() && !IsStopped())
+			RunAdaptive();
+		else
+		for(int i = 0;i < GetMultiplier() && !IsStopped();i++){
+			StepFDMExec();
 			if ( verbosityLevel == eDebug ){
 				mexPrintf("\tCall to Run completed\n");
 			}
@@ -881,21 +2284,29 @@ bool JSBSimInterface::UpdateStates(double *u_ptr, double *x_ptr, double *fc_ptr,
 		/* Flight Controls output vector [throttle left-aileron elevator tvc rudder flap right-aileron speedbrake
 		 * spoiler lef gear nosewheel-steering gear-unit-WOW]
 		 */
-		fc_ptr[0] = fdmExec->GetFCS()->GetThrottlePos(0);//fcs/throttle-pos-norm 
-		fc_ptr[1] = fdmExec->GetFCS()->GetDaLPos(0);//fcs/left-aileron-pos-rad 0=rad, 1=deg, 2=norm
-		fc_ptr[2] = fdmExec->GetFCS()->GetDePos(0);//fcs/elevator-pos-rad
-		fc_ptr[3] = fdmExec->GetPropertyValue("fcs/tvc-pos-rad");//tvc-pos-rad
-		fc_ptr[4] = fdmExec->GetFCS()->GetDrPos(0);//fcs/rudder-pos-rad
-		fc_ptr[5] = fdmExec->GetFCS()->GetDfPos(2);//fcs/flap-pos-norm
-		fc_ptr[6] = fdmExec->GetFCS()->GetDaRPos(0);//fcs/right-aileron-pos-rad
-		fc_ptr[7] = fdmExec->GetFCS()->GetDsbPos(0);//fcs/speedbrake-pos-rad
-		fc_ptr[8] = fdmExec->GetFCS()->GetDspPos(0);//fcs/spoiler-pos-rad
-		fc_ptr[9] = fdmExec->GetPropertyValue("fcs/lef-pos-rad");//lef-pos-rad
-		fc_ptr[10] = fdmExec->GetFCS()->GetGearPos();//gear/gear-pos-norm
-		fc_ptr[11] = fdmExec->GetFCS()->GetSteerPosDeg(0);//Nose-gear-steering-pos-deg
-		fc_ptr[12] = (int)fdmExec->GetPropertyValue("gear/unit/WOW");//Gear-WOW
+		if ((_output_groups & eFCSOutputs) && !_signal_map.outputs[eFCSPort].nodes.empty())
+			GatherSignals(_signal_map.outputs[eFCSPort], fc_ptr);
+		else if (_output_groups & eFCSOutputs)
+		{
+			fc_ptr[0] = fdmExec->GetFCS()->GetThrottlePos(0);//fcs/throttle-pos-norm 
+			fc_ptr[1] = fdmExec->GetFCS()->GetDaLPos(0);//fcs/left-aileron-pos-rad 0=rad, 1=deg, 2=norm
+			fc_ptr[2] = fdmExec->GetFCS()->GetDePos(0);//fcs/elevator-pos-rad
+			fc_ptr[3] = fdmExec->GetPropertyValue("fcs/tvc-pos-rad");//tvc-pos-rad
+			fc_ptr[4] = fdmExec->GetFCS()->GetDrPos(0);//fcs/rudder-pos-rad
+			fc_ptr[5] = fdmExec->GetFCS()->GetDfPos(2);//fcs/flap-pos-norm
+			fc_ptr[6] = fdmExec->GetFCS()->GetDaRPos(0);//fcs/right-aileron-pos-rad
+			fc_ptr[7] = fdmExec->GetFCS()->GetDsbPos(0);//fcs/speedbrake-pos-rad
+			fc_ptr[8] = fdmExec->GetFCS()->GetDspPos(0);//fcs/spoiler-pos-rad
+			fc_ptr[9] = fdmExec->GetPropertyValue("fcs/lef-pos-rad");//lef-pos-rad
+			fc_ptr[10] = fdmExec->GetFCS()->GetGearPos();//gear/gear-pos-norm
+			fc_ptr[11] = fdmExec->GetFCS()->GetSteerPosDeg(0);//Nose-gear-steering-pos-deg
+			fc_ptr[12] = (int)fdmExec->GetPropertyValue("gear/unit/WOW");//Gear-WOW
+		}
 
 
+     if ((_output_groups & ePropulsionOutputs) && !_signal_map.outputs[ePropulsionPort].nodes.empty())
+		GatherSignals(_signal_map.outputs[ePropulsionPort], p_ptr);
+     else if (_output_groups & ePropulsionOutputs)
      switch(eng_type)
 	 {
 	 case(2)://Piston engines
@@ -1231,17 +2642,22 @@ bool JSBSimInterface::UpdateStates(double *u_ptr, double *x_ptr, double *fc_ptr,
 
 		// Calculated Outputs output vector [pilot-Nz alpha alpha-dot beta beta-dot vc-fps vc-kts 
 		//                                   Vt-fps vg-fps mach climb-rate]
-		c_ptr[0] = fdmExec->GetPropertyValue("accelerations/Nz");//Nz
-		c_ptr[1] = fdmExec->GetAuxiliary()->Getalpha();// Alpha in radians
-		c_ptr[2] = fdmExec->GetAuxiliary()->Getadot();// Alphadot in radians/sec
-		c_ptr[3] = fdmExec->GetAuxiliary()->Getbeta();// Beta in radians
-		c_ptr[4] = fdmExec->GetAuxiliary()->Getbdot();// Betadot in radians/sec
-		c_ptr[5] = fdmExec->GetAuxiliary()->GetVcalibratedFPS();//Cal airspeed fps
-		c_ptr[6] = fdmExec->GetAuxiliary()->GetVcalibratedKTS();//Cal airspeed kts
-		c_ptr[7] = fdmExec->GetAuxiliary()->GetVt();//VT fps
-		c_ptr[8] = fdmExec->GetAuxiliary()->GetVground();//Vel ground fps
-		c_ptr[9] = fdmExec->GetAuxiliary()->GetMach();//Mach
-		c_ptr[10] = fdmExec->GetPropagate()->Gethdot();//h-dot-fps
+		if ((_output_groups & eCalculatedOutputs) && !_signal_map.outputs[eCalculatedPort].nodes.empty())
+			GatherSignals(_signal_map.outputs[eCalculatedPort], c_ptr);
+		else if (_output_groups & eCalculatedOutputs)
+		{
+			c_ptr[0] = fdmExec->GetPropertyValue("accelerations/Nz");//Nz
+			c_ptr[1] = fdmExec->GetAuxiliary()->Getalpha();// Alpha in radians
+			c_ptr[2] = fdmExec->GetAuxiliary()->Getadot();// Alphadot in radians/sec
+			c_ptr[3] = fdmExec->GetAuxiliary()->Getbeta();// Beta in radians
+			c_ptr[4] = fdmExec->GetAuxiliary()->Getbdot();// Betadot in radians/sec
+			c_ptr[5] = fdmExec->GetAuxiliary()->GetVcalibratedFPS();//Cal airspeed fps
+			c_ptr[6] = fdmExec->GetAuxiliary()->GetVcalibratedKTS();//Cal airspeed kts
+			c_ptr[7] = fdmExec->GetAuxiliary()->GetVt();//VT fps
+			c_ptr[8] = fdmExec->GetAuxiliary()->GetVground();//Vel ground fps
+			c_ptr[9] = fdmExec->GetAuxiliary()->GetMach();//Mach
+			c_ptr[10] = fdmExec->GetPropagate()->Gethdot();//h-dot-fps
+		}
 		
 
 		
@@ -1282,6 +2698,21 @@ bool JSBSimInterface::UpdateStates(double *u_ptr, double *x_ptr, double *fc_ptr,
 		mexPrintf("Call to UpdateStates completed\n");
 		mexPrintf("**********************************************************\n");
 		}
+		// telemetry, only every stream-every-th frame is gathered
+		if (_streamer.Due())
+		{
+			GatherSignals(_signal_map.stream, &_stream_values[0]);
+			_streamer.Send(fdmExec->GetSimTime(), &_stream_values[0]);
+		}
+		// MAT-file, one row per frame and output group
+		if (_mat.IsOpen())
+			WriteMatFrame(x_ptr, fc_ptr, p_ptr, c_ptr);
+		if (_journal.IsRecording() && _journal.CheckpointDue())
+			_journal.WriteCheckpoint(StateHash(x_ptr));
+		_stepping = false;
+		// real-time mode: hold the frame until its wall clock deadline
+		if (IsRealTime())
+			_pacer.Wait(dT*x_times/_rt_factor);
 		return 1;
 }
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -1315,17 +2746,24 @@ bool JSBSimInterface::UpdateStates(double *u_ptr, double *dx_ptr, double *x_ptr,
 
 	   /* New control inputs from S-Function 
 		* Control Input Vector = [throttle aileron elevator rudder mixture set-run flaps gear]
+		* unless the signal map declares its own inputs
 		*/
+		if (!_signal_map.inputs.nodes.empty())
+			ScatterSignals(_signal_map.inputs, u_ptr);
+		else
+		{
 		for(unsigned i=0;i<fdmExec->GetPropulsion()->GetNumEngines();i++)
 			fdmExec->GetFCS()->SetThrottleCmd(i, u_ptr[0]);//control the throttle(s)
 		fdmExec->GetFCS()->SetDaCmd(u_ptr[1]);//control the ailerons
 		fdmExec->GetFCS()->SetDeCmd(u_ptr[2]);//control the elevators
 		fdmExec->GetFCS()->SetDrCmd(u_ptr[3]);//control the rudder(s)
-		SetPropertyValue("fcs/mixture-cmd-norm",u_ptr[4]);//control the mixture
+		for(unsigned i=0;i<fdmExec->GetPropulsion()->GetNumEngines();i++)
+			fdmExec->GetFCS()->SetMixtureCmd(i, u_ptr[4]);//control the mixture(s)
 		for(unsigned i=0;i<fdmExec->GetPropulsion()->GetNumEngines();i++)
 			fdmExec->GetPropulsion()->GetEngine(i)->SetRunning(u_ptr[5]);//set engine(s) to running
 		fdmExec->GetFCS()->SetDfCmd(u_ptr[6]);//control the flaps
 		fdmExec->GetFCS()->SetGearCmd(u_ptr[7]);//control the gear position
+		}
 
 		//fdmExec->Run();
 		
@@ -1333,7 +2771,7 @@ bool JSBSimInterface::UpdateStates(double *u_ptr, double *dx_ptr, double *x_ptr,
 		//fdmExec->GetFCS()->Run();
 		//propagate->Run();
 		//auxiliary->Run();
-		fdmExec->Run();
+		StepFDMExec();
 		// Calculate state derivatives
 		//fdmExec->GetPropagate()->CalculatePQRdot();      // Angular rate derivative
 		//fdmExec->GetPropagate()->CalculateUVWdot();      // Translational rate derivative
@@ -1373,21 +2811,29 @@ bool JSBSimInterface::UpdateStates(double *u_ptr, double *dx_ptr, double *x_ptr,
 		/* Flight Controls output vector [throttle left-aileron elevator tvc rudder flap right-aileron speedbrake
 		 * spoiler lef gear nosewheel-steering gear-unit-WOW]
 		 */
-		fc_ptr[0] = fdmExec->GetFCS()->GetThrottlePos(0);//fcs/throttle-pos-norm 
-		fc_ptr[1] = fdmExec->GetFCS()->GetDaLPos(0);//fcs/left-aileron-pos-rad 0=rad, 1=deg, 2=norm
-		fc_ptr[2] = fdmExec->GetFCS()->GetDePos(0);//fcs/elevator-pos-rad
-		fc_ptr[3] = fdmExec->GetPropertyValue("fcs/tvc-pos-rad");//tvc-pos-rad
-		fc_ptr[4] = fdmExec->GetFCS()->GetDrPos(0);//fcs/rudder-pos-rad
-		fc_ptr[5] = fdmExec->GetFCS()->GetDfPos(2);//fcs/flap-pos-norm
-		fc_ptr[6] = fdmExec->GetFCS()->GetDaRPos(0);//fcs/right-aileron-pos-rad
-		fc_ptr[7] = fdmExec->GetFCS()->GetDsbPos(0);//fcs/speedbrake-pos-rad
-		fc_ptr[8] = fdmExec->GetFCS()->GetDspPos(0);//fcs/spoiler-pos-rad
-		fc_ptr[9] = fdmExec->GetPropertyValue("fcs/lef-pos-rad");//lef-pos-rad
-		fc_ptr[10] = fdmExec->GetFCS()->GetGearPos();//gear/gear-pos-norm
-		fc_ptr[11] = fdmExec->GetFCS()->GetSteerPosDeg(0);//Nose-gear-steering-pos-deg
-		fc_ptr[12] = (int)fdmExec->GetPropertyValue("gear/unit/WOW");//Gear-WOW
+		if ((_output_groups & eFCSOutputs) && !_signal_map.outputs[eFCSPort].nodes.empty())
+			GatherSignals(_signal_map.outputs[eFCSPort], fc_ptr);
+		else if (_output_groups & eFCSOutputs)
+		{
+			fc_ptr[0] = fdmExec->GetFCS()->GetThrottlePos(0);//fcs/throttle-pos-norm 
+			fc_ptr[1] = fdmExec->GetFCS()->GetDaLPos(0);//fcs/left-aileron-pos-rad 0=rad, 1=deg, 2=norm
+			fc_ptr[2] = fdmExec->GetFCS()->GetDePos(0);//fcs/elevator-pos-rad
+			fc_ptr[3] = fdmExec->GetPropertyValue("fcs/tvc-pos-rad");//tvc-pos-rad
+			fc_ptr[4] = fdmExec->GetFCS()->GetDrPos(0);//fcs/rudder-pos-rad
+			fc_ptr[5] = fdmExec->GetFCS()->GetDfPos(2);//fcs/flap-pos-norm
+			fc_ptr[6] = fdmExec->GetFCS()->GetDaRPos(0);//fcs/right-aileron-pos-rad
+			fc_ptr[7] = fdmExec->GetFCS()->GetDsbPos(0);//fcs/speedbrake-pos-rad
+			fc_ptr[8] = fdmExec->GetFCS()->GetDspPos(0);//fcs/spoiler-pos-rad
+			fc_ptr[9] = fdmExec->GetPropertyValue("fcs/lef-pos-rad");//lef-pos-rad
+			fc_ptr[10] = fdmExec->GetFCS()->GetGearPos();//gear/gear-pos-norm
+			fc_ptr[11] = fdmExec->GetFCS()->GetSteerPosDeg(0);//Nose-gear-steering-pos-deg
+			fc_ptr[12] = (int)fdmExec->GetPropertyValue("gear/unit/WOW");//Gear-WOW
+		}
 
 
+     if ((_output_groups & ePropulsionOutputs) && !_signal_map.outputs[ePropulsionPort].nodes.empty())
+		GatherSignals(_signal_map.outputs[ePropulsionPort], p_ptr);
+     else if (_output_groups & ePropulsionOutputs)
      switch(eng_type)
 	 {
 	 case(2)://Piston engines
@@ -1723,17 +3169,22 @@ bool JSBSimInterface::UpdateStates(double *u_ptr, double *dx_ptr, double *x_ptr,
 
 		// Calculated Outputs output vector [pilot-Nz alpha alpha-dot beta beta-dot vc-fps vc-kts 
 		//                                   Vt-fps vg-fps mach climb-rate]
-		c_ptr[0] = fdmExec->GetPropertyValue("accelerations/Nz");//Nz
-		c_ptr[1] = fdmExec->GetAuxiliary()->Getalpha();// Alpha in radians
-		c_ptr[2] = fdmExec->GetAuxiliary()->Getadot();// Alphadot in radians/sec
-		c_ptr[3] = fdmExec->GetAuxiliary()->Getbeta();// Beta in radians
-		c_ptr[4] = fdmExec->GetAuxiliary()->Getbdot();// Betadot in radians/sec
-		c_ptr[5] = fdmExec->GetAuxiliary()->GetVcalibratedFPS();//Cal airspeed fps
-		c_ptr[6] = fdmExec->GetAuxiliary()->GetVcalibratedKTS();//Cal airspeed kts
-		c_ptr[7] = fdmExec->GetAuxiliary()->GetVt();//VT fps
-		c_ptr[8] = fdmExec->GetAuxiliary()->GetVground();//Vel ground fps
-		c_ptr[9] = fdmExec->GetAuxiliary()->GetMach();//Mach
-		c_ptr[10] = fdmExec->GetPropagate()->Gethdot();//h-dot-fps
+		if ((_output_groups & eCalculatedOutputs) && !_signal_map.outputs[eCalculatedPort].nodes.empty())
+			GatherSignals(_signal_map.outputs[eCalculatedPort], c_ptr);
+		else if (_output_groups & eCalculatedOutputs)
+		{
+			c_ptr[0] = fdmExec->GetPropertyValue("accelerations/Nz");//Nz
+			c_ptr[1] = fdmExec->GetAuxiliary()->Getalpha();// Alpha in radians
+			c_ptr[2] = fdmExec->GetAuxiliary()->Getadot();// Alphadot in radians/sec
+			c_ptr[3] = fdmExec->GetAuxiliary()->Getbeta();// Beta in radians
+			c_ptr[4] = fdmExec->GetAuxiliary()->Getbdot();// Betadot in radians/sec
+			c_ptr[5] = fdmExec->GetAuxiliary()->GetVcalibratedFPS();//Cal airspeed fps
+			c_ptr[6] = fdmExec->GetAuxiliary()->GetVcalibratedKTS();//Cal airspeed kts
+			c_ptr[7] = fdmExec->GetAuxiliary()->GetVt();//VT fps
+			c_ptr[8] = fdmExec->GetAuxiliary()->GetVground();//Vel ground fps
+			c_ptr[9] = fdmExec->GetAuxiliary()->GetMach();//Mach
+			c_ptr[10] = fdmExec->GetPropagate()->Gethdot();//h-dot-fps
+		}
 		
 
 		
@@ -1774,6 +3225,18 @@ bool JSBSimInterface::UpdateStates(double *u_ptr, double *dx_ptr, double *x_ptr,
 		mexPrintf("Call to UpdateStates completed\n");
 		mexPrintf("**********************************************************\n");
 		}
+		// telemetry, only every stream-every-th frame is gathered
+		if (_streamer.Due())
+		{
+			GatherSignals(_signal_map.stream, &_stream_values[0]);
+			_streamer.Send(fdmExec->GetSimTime(), &_stream_values[0]);
+		}
+		// MAT-file, one row per frame and output group
+		if (_mat.IsOpen())
+			WriteMatFrame(x_ptr, fc_ptr, p_ptr, c_ptr);
+		// real-time mode: hold the frame until its wall clock deadline
+		if (IsRealTime())
+			_pacer.Wait(dT*x_times/_rt_factor);
 		return 1;
 
 }
\ No newline at end of file
@@ -7,14 +7,148 @@
 #include <models/FGAuxiliary.h>
 #include <models/FGPropulsion.h>
 #include <models/FGFCS.h>
+#include "RealTimePacer.h"
+#include "TelemetryStreamer.h"
+#include "StatReducer.h"
+#include "HistoryBuffer.h"
+#include "MatFileWriter.h"
+#include "InputJournal.h"
+#include "AircraftData.h"
 
 using namespace JSBSim;
 
+/// A list of properties gathered into one output vector, or scattered from the input vector
+/*
+	names/scales come from the signal map, nodes are resolved once when the
+	aircraft is loaded so that the gather is an indexed read per signal.
+	For inputs one name can fan out to several nodes; index holds the
+	vector element each node is set from.
+*/
+struct JISignalList
+{
+	vector<string> names;
+	vector<double> scales;
+	vector<FGPropertyManager*> nodes;
+	vector<int> index;
+};
+
+/// Signal map read from a sidecar file, one list per S-function output port
+/*
+	File format, one signal per line, '#' starts a comment:
+		output <port> <property> [unit]
+		input <property> [unit]
+	port is 1 (flight controls), 2 (propulsion) or 3 (calculated outputs);
+	port 0 always carries the 12 discrete states. unit is either a number
+	the value is multiplied with on its way from JSBSim to Simulink (or from
+	Simulink to JSBSim for inputs), or one of
+		deg (from rad)  rad (from deg)  kts (from ft/s)  mps (from ft/s)
+		fpm (from ft/s) m (from ft)     ft (from m)
+	Each input line is one element of the input port, in file order. A
+	property containing [*] is set on every engine, e.g.
+		input fcs/throttle-cmd-norm[*]      # one lever for all engines
+		input fcs/throttle-cmd-norm[1]      # or a lever per engine
+		input ap/altitude_setpoint m
+	A port without entries keeps its built-in layout, for the input port
+	the 8 controls [throttle aileron elevator rudder mixture set-run flaps gear].
+
+	Telemetry streamed by UpdateStates, see TelemetryStreamer.h:
+		stream <property> [unit]
+		stream-to udp:127.0.0.1:5500      # or unix:/tmp/jsbsim.sock
+		stream-every <n>                  # every n-th frame, default 1
+		stream-delta <0|1>                # delta frames, default 0
+
+	History kept in memory after every JSBSim step, see HistoryBuffer.h:
+		record <property> [unit]
+		record-every <n>                  # every n-th step, default 1
+
+	Outputs streamed to a MAT-file by UpdateStates, see JSBSimInterface::OpenMatFile:
+		mat-file run42.mat
+
+	Stop conditions, see JSBSimInterface::AddStopCondition:
+		stop gear/wow > 0                 # touchdown
+		stop position/h-agl-ft < 50       # altitude floor
+		stop accelerations/Nz > 4.5       # load factor limit
+		stop nan                          # NaN in the state vector
+
+	Statistics, see JSBSimInterface::AddStatistic:
+		stat accelerations/Nz q 0.5 0.99 > 3.8
+		stat aero/alpha-deg q 0.95
+		stat velocities/h-dot-fps < -1000
+*/
+struct JISignalMap
+{
+	JISignalMap() : stream_every(1), stream_delta(false), record_every(1) {}
+	JISignalList outputs[4];
+	JISignalList inputs;
+	JISignalList stream;
+	string stream_to;
+	int stream_every;
+	bool stream_delta;
+	JISignalList record;
+	int record_every;
+	string mat_file;
+	vector<string> stops;
+	vector<string> stats;
+};
+
+/// Initial condition names resolved once to setters, see JSBSimInterface::ResolveInitList
+struct JIInitList
+{
+	vector<string> names;
+	vector<int> setters;				// JSBSimInterface::JIInitSetter
+	vector<FGPropertyManager*> nodes;	// for eSetNode entries
+};
+
+/// A resolved stop condition, see JSBSimInterface::AddStopCondition
+struct JIStopCondition
+{
+	string spec;
+	FGPropertyManager *node;	// NULL for the NaN check
+	int op;						// JSBSimInterface::JIStopOp
+	double threshold;
+};
+
+/// A statistic of one property, see JSBSimInterface::AddStatistic
+struct JIStatistic
+{
+	string spec;
+	FGPropertyManager *node;
+	SignalStats stats;
+};
+
+/// The simulation state a checkpoint or a rollout starts from, see JSBSimInterface::TakeSnapshot
+struct JISnapshot
+{
+	double sim_time;
+	double state[13];			// ECEF location, body velocities, body rates, attitude quaternion
+	vector<double> tanks;		// contents
+	vector<double> rpm;			// per thruster
+	std::shared_ptr<const vector<string> > names;	// readable and writable numeric properties,
+												// the aircraft's shared list unless rescanned
+	vector<double> values;
+};
+
+/// Outcome of JSBSimInterface::ReplayJournal
+struct JIReplayReport
+{
+	JIReplayReport() : loaded(false), aircraft_changed(false), steps(0), checkpoints(0),
+		last_good_step(0), diverged_step(-1), sim_time(0.0), wall_time(0.0) {}
+	bool loaded;				// journal read and aircraft opened
+	bool aircraft_changed;		// the aircraft file is not the recorded one
+	uint64_t steps;				// UpdateStates calls replayed
+	uint64_t checkpoints;		// checkpoints that matched
+	int64_t last_good_step;		// step of the last matching checkpoint
+	int64_t diverged_step;		// step of the first checkpoint that did not match, -1 if none
+	double sim_time, wall_time;
+	string error;
+};
+
 class JSBSimInterface
 {
 public:
 	FGFDMExec *fdmExec;
-	JSBSimInterface(FGFDMExec *, double dt);
+	/// announce = false skips the start-up messages, for instances built off the Matlab thread
+	JSBSimInterface(FGFDMExec *, double dt, bool announce = true);
 	~JSBSimInterface(void);
 	/// Open an aircraft model from Matlab
 	bool Open(string prop);
@@ -31,6 +165,8 @@ public:
 	/// Print the aircraft catalog
 	void PrintCatalog(void);
 	bool IsAircraftLoaded(){return _ac_model_loaded;}
+	/// Catalog, property list and file hash shared by all instances of the aircraft, see AircraftData.h
+	const AircraftData& GetAircraftData(){return *_aircraft;}
 	/// Set an initial state
 	/*
 		*prhs1 is a Matlab structure of strings/values couples, 
@@ -41,6 +177,21 @@ public:
 	*/
 	bool ResetToInitialCondition(void);
 	bool Init(const mxArray *prhs1);
+	/// Numeric initialization
+	/*
+		The names are the ones Init(mxArray) accepts. ResolveInitList maps
+		each to a setter once: the 12 states are written straight into the
+		vehicle state (the three Euler angles as one quaternion) and followed
+		by a single propagate/auxiliary run, properties found in the catalog
+		become property nodes, the remaining easy-set names ("set-running",
+		"fcs/throttle-cmd-norm", "multiplier", ...) go through EasySetValue.
+		Init(list, values) then takes one value per name, in list order, with
+		no string or mxArray work for states and properties.
+	*/
+	enum JIInitSetter {eSetU=0, eSetV, eSetW, eSetP, eSetQ, eSetR, eSetH, eSetLong, eSetLat,
+		eSetPhi, eSetTheta, eSetPsi, eSetNode, eSetEasy};
+	bool ResolveInitList(const vector<string>& names, JIInitList& list);
+	bool Init(const JIInitList& list, const double *values);
 	/// put the 16 dotted quantities into statedot:
 	/*
 	dot of (u,v,w,p,q,r,q1,q2,q3,q4,x,y,z,phi,theta,psi)
@@ -50,6 +201,8 @@ public:
 
 	// Wrapper functions to the FGFDMExec class
 	bool RunFDMExec() {return fdmExec->Run();}
+	/// One JSBSim frame followed by the history, the statistics and the stop conditions
+	bool StepFDMExec();
 	bool RunPropagate() {return propagate->Run();}
 	bool RunAuxiliary() {return auxiliary->Run();}
 	bool RunPropulsion() {return propulsion->Run();}
@@ -62,8 +215,247 @@ public:
 	void SetVerbosity(const JIVerbosityLevel vl) {verbosityLevel = vl;}
 	void SetMultiplier(double multiple){ x_times = multiple;}
 	double	GetMultiplier(){return x_times;}
+
+	/// Integration schemes, same numbering as FGPropagate::eIntegrateType
+	/*
+		Stability interval is the range of dt*lambda (lambda real, negative) for
+		which x' = lambda*x stays bounded. The fastest mode of the aircraft
+		(usually gear contact, then short period) sets the usable dt.
+
+		scheme               order  stable dt*lambda   notes
+		eIntNone               -        -              state is frozen
+		eIntRectEuler          1    [-2.0,  0]         cheapest, least accurate
+		eIntTrapezoidal        1    (-2.0,  0)         JSBSim form, averages last two derivatives
+		eIntAdamsBashforth2    2    (-1.0,  0)
+		eIntAdamsBashforth3    3    (-0.545,0)         ~2x dt of AB2 for the same error in cruise
+		eIntAdamsBashforth4    4    (-0.3,  0)         ~3-4x dt of AB2 for the same error in cruise
+
+		Higher order buys accuracy, not stability: for batch runs use AB3/AB4 on
+		the rates with a larger dt only while dt*lambda of the gear/short-period
+		modes stays inside the interval above. The Adams-Bashforth schemes
+		assume a constant dt between calls to Run().
+	*/
+	enum JIIntegrator {eIntNone=0, eIntRectEuler, eIntTrapezoidal,
+		eIntAdamsBashforth2, eIntAdamsBashforth3, eIntAdamsBashforth4};
+	/// Select the integrators used by FGPropagate for this instance
+	bool SetIntegrators(int rot_rate, int trans_rate, int rot_pos, int trans_pos);
+	/// Select one integrator, e.g. SetIntegrator("rate/rotational", eIntAdamsBashforth3)
+	bool SetIntegrator(const string which, int type);
+	/// Change the JSBSim time step of this instance
+	bool SetDeltaT(double dt);
+
+	/// Adaptive multiplier
+	/*
+		The Simulink frame stays dT*multiplier long, but the number of JSBSim
+		substeps per frame is chosen from a local error estimate instead of
+		being fixed. After each substep of length h the change in the body
+		accelerations gives err = 0.5*h*|d(UVWdot)| / max(|UVW|,1 ft/s) and
+		err = 0.5*h*|d(PQRdot)| (rad/s); the largest one over the frame is
+		compared to the tolerance. The substep count is doubled for the next
+		frame when err > tol and halved when err < tol/8, within [min_sub, max_sub].
+		Gear contact and stall show up as large jumps in the accelerations,
+		cruise as almost none. tol <= 0 switches back to the fixed multiplier.
+	*/
+	void SetAdaptiveMultiplier(double tol, int min_sub, int max_sub);
+	bool IsAdaptive(){return _adaptive_tol > 0.0;}
+	/// Substeps that will be used for the next frame
+	int GetAdaptiveSubsteps(){return _adaptive_substeps;}
+	/// Error estimate of the last frame
+	double GetAdaptiveError(){return _adaptive_err;}
+
+	/// Execution schedule
+	/*
+		A model given a rate of n only runs every n-th call to fdmExec->Run()
+		and holds its outputs in between (FGModel::SetRate). JSBSim scales the
+		integration done inside such a model by its rate, e.g. engine spool-up
+		and fuel burn use dt*n, so fuel totals stay right at a divided rate.
+		Divisible: "propulsion", "atmosphere", "auxiliary", "aerodynamics" and
+		"massbalance". Propagate, FCS and ground reactions always run every frame.
+	*/
+	bool SetModelRate(const string model, int rate);
+	/// Rate of a scheduled model, 0 if the name is unknown
+	int GetModelRate(const string model);
+	/// Take over the multiplier, the adaptive settings and the model rates of another instance
+	/*
+		The adaptive substep count restarts from the fixed multiplier, so a
+		copy made before every run steps the same way whatever ran before.
+	*/
+	void CopySchedule(JSBSimInterface& other);
+
+	/// Engine pre-conditioning
+	/*
+		Spools the engines up to the commanded power with the airframe frozen:
+		only the FCS and propulsion models are run, at the nominal dt and with
+		fuel burn off (trim mode), until thrust, RPM and N1/N2 of every engine
+		change by less than tol (relative) for a number of consecutive
+		iterations. Returns the iterations used, or -1 when max_iter was
+		reached first. Init() calls it once after all properties are set.
+	*/
+	int SpoolUpEngines(int max_iter, double tol);
+	/// Iterations used by the last spool-up
+	int GetSpoolUpIterations(){return _spool_iterations;}
+
+	/// Output groups filled in by UpdateStates
+	/*
+		The state vector is always written. Flight control, propulsion and
+		calculated outputs are only gathered for the groups set here, so
+		unconnected Simulink ports cost no property reads.
+	*/
+	enum JIOutputGroup {eFCSOutputs=1, ePropulsionOutputs=2, eCalculatedOutputs=4, eAllOutputs=7};
+	void SetOutputGroups(int groups){_output_groups = groups;}
+	int GetOutputGroups(){return _output_groups;}
+
+	/// Real-time mode
+	/*
+		With a factor > 0 every UpdateStates call is held until its wall clock
+		deadline, one frame being dT*multiplier/factor seconds. Pacing, CPU
+		pinning, priority and the miss/jitter statistics are done by the
+		RealTimePacer, see RealTimePacer.h. Set from Init as "realtime/factor",
+		"realtime/cpu", "realtime/priority" and "realtime/spin-us"; the CPU
+		and priority are only applied to a thread of our own, the pipeline's.
+	*/
+	bool IsRealTime(){return _rt_factor > 0.0;}
+	/// Telemetry of the signal map's stream entries, open once the map is resolved
+	TelemetryStreamer& GetStreamer(){return _streamer;}
+	RealTimePacer& GetPacer(){return _pacer;}
+
+	/// Compressed history of the recorded properties
+	/*
+		Filled by StepFDMExec with [sim-time recorded...] every record_every-th
+		step, restarted by Init. SetRecordList replaces the signal map's
+		record entries; the history is decoded on demand, e.g. by MexJSBSim 'history'.
+	*/
+	bool SetRecordList(const vector<string>& names, int every);
+	const vector<string>& GetRecordNames(){return _signal_map.record.names;}
+	HistoryBuffer& GetHistory(){return _history;}
+
+	/// MAT-file of the outputs, see MatFileWriter.h
+	/*
+		Every UpdateStates call appends a row [sim-time outputs...] to the
+		variables states, fcs, propulsion and calculated, the last three only
+		while their output group is set. The column names are in
+		states_names etc. The file is written by CloseMatFile, or when the
+		interface is deleted, and loads into Matlab without a conversion.
+		Needs a loaded aircraft; a signal map's mat-file entry opens it.
+	*/
+	bool OpenMatFile(const string file);
+	bool CloseMatFile(void);
+	MatFileWriter& GetMatFile(){return _mat;}
+
+	/// Input journal and replay, see InputJournal.h
+	/*
+		StartJournal records the aircraft, dt, multiplier, signal map inputs
+		and stop conditions, then every Init(list, values), every property
+		set made between steps, every LoadCheckpoint and the inputs of every
+		UpdateStates(u, x, ...) call, with a hash of sim-time and the 12
+		states every checkpoint_every steps. Start it after Open and before
+		Init. ReplayJournal re-drives a fresh, silent instance from the
+		journal as fast as it runs, without Simulink and without the
+		realtime/... init entries, and stops at the first checkpoint that
+		does not match; true if all of them did. The Simulink-integrated
+		UpdateStates(u, dx, x, ...) is not recorded.
+	*/
+	bool StartJournal(const string file, int checkpoint_every);
+	void StopJournal(void){_journal.Close();}
+	InputJournal& GetJournal(){return _journal;}
+	static bool ReplayJournal(const string file, JIReplayReport& report);
+
+	/// Snapshots of the simulation state, in memory
+	/*
+		TakeSnapshot copies sim-time, the vehicle state (location, body
+		velocities and rates, attitude quaternion, all bit exact), the
+		contents of every tank, the rpm of every thruster and the value of
+		every readable and writable property: commands, FCS outputs written
+		to properties, engine running flags, atmosphere and wind settings,
+		the integrator choice. The property list is the one shared by every
+		instance of the aircraft (AircraftData), so a snapshot holds a
+		pointer to it and only its values; rescan walks this instance's
+		tree again for properties created since. RestoreSnapshot needs the
+		same aircraft; it re-initializes the propagate and FCS models, sets
+		the properties, then the vehicle state, and derives the rest as Init
+		does, without spooling up the engines. So every restore of a
+		snapshot starts the same way, whatever the instance ran before.
+		JSBSim keeps some state private, which a snapshot cannot reach: the
+		past derivatives of the multistep integrators (the first steps after
+		a restore are those of a fresh start), the inner state of FCS
+		filters, integrators and PID components that do not write a
+		property, and engine internals other than running and rpm. A run
+		continued from a snapshot therefore stays close to the uninterrupted
+		one but is not bit identical.
+	*/
+	void TakeSnapshot(JISnapshot& snap, bool rescan = false);
+	bool RestoreSnapshot(const JISnapshot& snap);
+
+	/// Snapshots on disk, to warm-start runs from a common state
+	/*
+		A versioned binary file of the aircraft name, a hash of its file and
+		dt, followed by a snapshot. LoadCheckpoint refuses another version,
+		aircraft or dt. A journal records the load with a hash of the file,
+		ReplayJournal loads the same file again and refuses a changed one.
+	*/
+	bool SaveCheckpoint(const string file);
+	bool LoadCheckpoint(const string file);
+
+	/// Stop conditions
+	/*
+		"<property> <op> <value>" with op one of > >= < <= == !=, or "nan"
+		for a NaN in the 12 states. They are checked after every
+		fdmExec->Run() of UpdateStates and of the ensemble and serve loops;
+		the first one that holds stops the run. A stopped instance is not
+		stepped any more, GetStopReason() returns the number of the condition
+		(1 for the first one added, 0 while running) and GetStopTime() the
+		sim time it held at. Init clears the stop but keeps the conditions.
+		A signal map with stop entries replaces the conditions when resolved.
+	*/
+	enum JIStopOp {eStopGreater=0, eStopGreaterEqual, eStopLess, eStopLessEqual,
+		eStopEqual, eStopNotEqual, eStopNaN};
+	static bool ParseStopCondition(const string spec, string& prop, int& op, double& threshold);
+	/// Add a condition for the loaded aircraft, returns its reason code or 0 if it is invalid
+	int AddStopCondition(const string spec);
+	void ClearStopConditions(){_stops.clear(); _stop_reason = 0;}
+	/// Evaluate the conditions on the current state, true once stopped
+	bool CheckStopConditions(void);
+	bool IsStopped(){return _stop_reason != 0;}
+	int GetStopReason(){return _stop_reason;}
+	double GetStopTime(){return _stop_time;}
+	/// The condition behind a reason code, empty if there is none
+	string GetStopCondition(int reason){return (reason > 0 && reason <= (int)_stops.size()) ? _stops[reason-1].spec : string();}
+
+	/// Streaming statistics
+	/*
+		"<property> [q <p> <p>...] [> <threshold> | < <threshold>]": moments and
+		extrema with their sim time are always kept, "q" adds P-square
+		quantile estimates (p in 0..1), a threshold counts the samples, the
+		time and the separate excursions beyond it; see StatReducer.h. Fed
+		after every step like the stop conditions, so a batch run returns a
+		few numbers per signal instead of its history. Init restarts them.
+		A signal map with stat entries replaces the statistics when resolved.
+	*/
+	static bool ParseStatistic(const string spec, string& prop, SignalStats& stats);
+	/// Add a statistic for the loaded aircraft, returns its number or 0 if it is invalid
+	int AddStatistic(const string spec);
+	void ClearStatistics(){_statistics.clear();}
+	const vector<JIStatistic>& GetStatistics(){return _statistics;}
+
+	/// Output ports, also the index into JISignalMap::outputs
+	enum JIOutputPort {eStatePort=0, eFCSPort, ePropulsionPort, eCalculatedPort, eNumOutputPorts};
+	/// Read a signal map file, error describes the first bad line
+	static bool ReadSignalMap(const string file, JISignalMap& map, string& error);
+	/// Use a signal map; its properties are resolved now or when the aircraft is loaded
+	bool SetSignalMap(const JISignalMap& map);
+	const JISignalMap& GetSignalMap(){return _signal_map;}
+	double GetDeltaT(){return dT;}
+	/// Width of an output port, either from the signal map or the built-in layout
+	int GetOutputWidth(int port){return GetOutputWidth(_signal_map, port);}
+	static int GetOutputWidth(const JISignalMap& map, int port);
+	/// Names of the signals of an output port, property paths for the built-in layouts
+	static void GetOutputNames(const JISignalMap& map, int port, vector<string>& names);
+	/// Width of the input port, either from the signal map or the built-in layout
+	int GetInputWidth(){return GetInputWidth(_signal_map);}
+	static int GetInputWidth(const JISignalMap& map);
 	double JSBSimInterface::GetEulerDot(int i);
 	bool JSBSimInterface::SetEuler(int i, double value);
+	/// One frame; no MEX API call below debug verbosity, so it may run off the Matlab thread
 	bool UpdateStates(double *u_ptr, double *x_ptr, double *fc_ptr, double *p_ptr, double *c_ptr);
 	bool UpdateStates(double *u_ptr, double *dx_ptr, double *x_ptr, double *fc_ptr, double *p_ptr, double *c_ptr);
 
@@ -72,7 +464,7 @@ private:
 	
 	FGPropagate *propagate;
 	FGAuxiliary *auxiliary;
-	vector<string> catalog;
+	AircraftDataPtr _aircraft;
 	FGInitialCondition *ic;
 	FGAerodynamics *aerodynamics;
 	FGPropulsion *propulsion;
@@ -96,6 +488,43 @@ private:
 	double _alphadot,_betadot,_hdot;
 	double	x_times;
 
+	FGModel* GetScheduledModel(const string model);
+	bool FinishInit(bool success);
+
+	int _output_groups;
+	double _rt_factor;
+	RealTimePacer _pacer;
+	TelemetryStreamer _streamer;
+	vector<double> _stream_values;
+	HistoryBuffer _history;
+	vector<double> _record_values;
+	MatFileWriter _mat;
+	int _mat_vars[eNumOutputPorts];
+	void WriteMatFrame(const double *x_ptr, const double *fc_ptr, const double *p_ptr, const double *c_ptr);
+	InputJournal _journal;
+	bool _stepping;				// inside UpdateStates, its own property sets are not journaled
+	uint64_t StateHash(const double *x_ptr);
+	std::shared_ptr<const vector<string> > _snapshot_names;
+	vector<FGPropertyManager*> _snapshot_nodes;	// resolved on first use
+	void SetSnapshotNames(const std::shared_ptr<const vector<string> >& names);
+	void ResolveSnapshotNodes(void);
+	bool ResolveRecordList(void);
+	JISignalMap _signal_map;
+	vector<JIStopCondition> _stops;
+	vector<JIStatistic> _statistics;
+	void UpdateStatistics(void);
+	int _stop_reason;
+	double _stop_time;
+	bool ResolveSignalMap(void);
+	void GatherSignals(const JISignalList& list, double *ptr);
+	void ScatterSignals(const JISignalList& list, const double *ptr);
+	int _spool_max_iter, _spool_iterations;
+	double _spool_tol;
+
+	bool RunAdaptive(void);
+	double _adaptive_tol, _adaptive_err;
+	int _adaptive_min, _adaptive_max, _adaptive_substeps;
+
 };
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 #endif
@@ -0,0 +1,95 @@
+#ifndef JSBSIMLOCKFREE_HEADER_H
+#define JSBSIMLOCKFREE_HEADER_H
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+/// Bounded single-producer/single-consumer queue
+/*
+	One thread calls Push(), one other thread calls Pop(); neither ever
+	blocks. Capacity must be a power of two, one slot is kept free to tell
+	a full queue from an empty one.
+*/
+template <class T, size_t Capacity>
+class SPSCQueue
+{
+public:
+	SPSCQueue(void) : _head(0), _tail(0) {}
+
+	/// Producer side, false if the queue is full
+	bool Push(const T& item)
+	{
+		const size_t tail = _tail.load(std::memory_order_relaxed);
+		const size_t next = (tail + 1) & (Capacity - 1);
+		if (next == _head.load(std::memory_order_acquire)) return false;
+		_items[tail] = item;
+		_tail.store(next, std::memory_order_release);
+		return true;
+	}
+	/// Consumer side, false if the queue is empty
+	bool Pop(T& item)
+	{
+		const size_t head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire)) return false;
+		item = _items[head];
+		_head.store((head + 1) & (Capacity - 1), std::memory_order_release);
+		return true;
+	}
+
+private:
+	static_assert((Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+	T _items[Capacity];
+	// producer and consumer indices on separate cache lines; padding rather
+	// than alignas, which operator new does not honour before C++17
+	char _pad0[64];
+	std::atomic<size_t> _head;
+	char _pad1[64];
+	std::atomic<size_t> _tail;
+	char _pad2[64];
+};
+
+/// Latest-value snapshot of a vector of doubles guarded by a sequence lock
+/*
+	A single writer publishes without ever waiting for readers; readers
+	retry while a write is in progress, so they always see one complete
+	frame. The sequence number is odd during a write, Read() returns the
+	number of frames written so far.
+*/
+class SeqLockSnapshot
+{
+public:
+	explicit SeqLockSnapshot(size_t n) : _seq(0), _data(n) {}
+
+	size_t Size() const {return _data.size();}
+
+	/// Writer side
+	void Write(const double *src)
+	{
+		const unsigned seq = _seq.load(std::memory_order_relaxed);
+		_seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i=0; i<_data.size(); i++)
+			_data[i].store(src[i], std::memory_order_relaxed);
+		_seq.store(seq + 2, std::memory_order_release);
+	}
+	/// Reader side, copies the latest complete frame
+	unsigned Read(double *dst) const
+	{
+		unsigned before, after;
+		do {
+			before = _seq.load(std::memory_order_acquire);
+			for (size_t i=0; i<_data.size(); i++)
+				dst[i] = _data[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = _seq.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+		return before / 2;
+	}
+
+private:
+	std::atomic<unsigned> _seq;
+	std::vector< std::atomic<double> > _data;
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
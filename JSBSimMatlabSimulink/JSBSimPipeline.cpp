@@ -0,0 +1,82 @@
+#include "StdAfx.h"
+#include "JSBSimPipeline.h"
+
+JSBSimPipeline::JSBSimPipeline(JSBSimInterface *jii, int n_inputs, int n_states, int n_fc, int n_p, int n_c)
+	: _jii(jii), _u(n_inputs), _x(n_states), _fc(n_fc), _p(n_p), _c(n_c),
+	  _groups(JSBSimInterface::eAllOutputs), _time(0.0), _collected_time(0.0),
+	  _pending(false), _running(false), _failed(false), _quit(false)
+{
+	_jii->SetVerbosity(JSBSimInterface::eSilent);
+	_jii->GetPacer().SetDedicatedThread(true); // realtime/cpu and realtime/priority go to the worker
+	_thread = std::thread(&JSBSimPipeline::Worker, this);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+JSBSimPipeline::~JSBSimPipeline(void)
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_cv.wait(lock, [this]{ return !_running; }); // a frame in flight is finished and dropped
+		_quit = true;
+	}
+	_cv.notify_all();
+	_thread.join();
+	_jii->GetPacer().SetDedicatedThread(false);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimPipeline::Start(const double *u_ptr, int groups)
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_cv.wait(lock, [this]{ return !_running; });
+		for (size_t i=0; i<_u.size(); i++)
+			_u[i] = u_ptr[i];
+		_groups = groups;
+		_running = true;
+		_pending = true;
+	}
+	_cv.notify_all();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimPipeline::Collect(double *x_ptr, double *fc_ptr, double *p_ptr, double *c_ptr)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_cv.wait(lock, [this]{ return !_running; });
+	if (!_pending || _failed) return 0;
+	_pending = false;
+	_collected_time = _time;
+
+	size_t i;
+	for (i=0; i<_x.size(); i++)  x_ptr[i] = _x[i];
+	for (i=0; i<_fc.size(); i++) fc_ptr[i] = _fc[i];
+	for (i=0; i<_p.size(); i++)  p_ptr[i] = _p[i];
+	for (i=0; i<_c.size(); i++)  c_ptr[i] = _c[i];
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimPipeline::Worker(void)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	for (;;)
+	{
+		_cv.wait(lock, [this]{ return _running || _quit; });
+		if (_quit) return;
+
+		// the buffers belong to the worker while _running is set
+		lock.unlock();
+		bool ok = true;
+		try {
+			_jii->SetOutputGroups(_groups);
+			_jii->UpdateStates(&_u[0], &_x[0], _fc.empty() ? 0 : &_fc[0],
+				_p.empty() ? 0 : &_p[0], _c.empty() ? 0 : &_c[0]);
+			_time = _jii->fdmExec->GetSimTime();
+		} catch (...) {
+			ok = false;
+		}
+		lock.lock();
+
+		if (!ok) _failed = true;
+		_running = false;
+		_cv.notify_all();
+	}
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -0,0 +1,52 @@
+#ifndef JSBSIMPIPELINE_HEADER_H
+#define JSBSIMPIPELINE_HEADER_H
+
+#include "JSBSimInterface.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/// Pipelined stepping of a JSBSimInterface on a worker thread
+/*
+	Start() latches the inputs of frame k and returns at once; the worker
+	then runs UpdateStates for frame k while the caller evaluates the rest
+	of the diagram. Collect() waits for that frame and copies its results
+	out, so the outputs trail the inputs by one frame. This is only valid
+	for blocks without direct feedthrough.
+
+	The worker must not call the MEX API. UpdateStates sets every input
+	through FCS setters or resolved property nodes, with no mxArray, so
+	only its diagnostic prints remain; the interface is switched to silent
+	verbosity for as long as the pipeline exists to keep those off.
+*/
+class JSBSimPipeline
+{
+public:
+	JSBSimPipeline(JSBSimInterface *jii, int n_inputs, int n_states, int n_fc, int n_p, int n_c);
+	~JSBSimPipeline(void);
+	/// Start a frame on the worker with the given inputs and output groups
+	void Start(const double *u_ptr, int groups);
+	/// Wait for the frame in flight and copy its results; false if there was none or it failed
+	bool Collect(double *x_ptr, double *fc_ptr, double *p_ptr, double *c_ptr);
+	/// JSBSim sim-time of the frame the last Collect() returned
+	double GetSimTime(){return _collected_time;}
+	/// True if the last frame threw inside JSBSim
+	bool Failed(){return _failed;}
+
+private:
+	void Worker(void);
+
+	JSBSimInterface *_jii;
+	vector<double> _u, _x, _fc, _p, _c;
+	int _groups;
+	double _time, _collected_time;
+
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	bool _pending;	// a frame was started and not collected yet
+	bool _running;	// the worker owns the buffers
+	bool _failed, _quit;
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
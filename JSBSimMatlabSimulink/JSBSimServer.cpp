@@ -0,0 +1,88 @@
+#include "StdAfx.h"
+#include "JSBSimServer.h"
+
+JSBSimServer::JSBSimServer(JSBSimInterface *jii)
+	: _jii(jii), _rate(0.0), _snapshot(0L), _quit(false), _stopped(false)
+{
+	_pacer.SetDedicatedThread(true); // only ever waited on by the serve loop
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+JSBSimServer::~JSBSimServer(void)
+{
+	Stop();
+	delete _snapshot;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimServer::Start(double rate_hz, const vector<string>& watch)
+{
+	if (IsRunning() || rate_hz <= 0.0 || !_jii->IsAircraftLoaded()) return 0;
+
+	_watch.clear();
+	for (unsigned i=0; i<watch.size(); i++)
+	{
+		FGPropertyManager *node = _jii->fdmExec->GetPropertyManager()->GetNode(watch[i]);
+		if (!node)
+		{
+			mexPrintf("\tERROR: '%s' is not in the aircraft catalog.\n", watch[i].c_str());
+			return 0;
+		}
+		_watch.push_back(node);
+	}
+
+	delete _snapshot;
+	_snapshot = new SeqLockSnapshot(_watch.size() + 1);
+	_rate = rate_hz;
+	_pacer.Reset();
+	_quit.store(false);
+	_stopped.store(false);
+	_thread = std::thread(&JSBSimServer::Loop, this);
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimServer::Stop(void)
+{
+	if (!IsRunning()) return;
+	_quit.store(true);
+	_thread.join();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool JSBSimServer::Command(const string prop, double value)
+{
+	PropertyCommand cmd;
+	cmd.node = _jii->fdmExec->GetPropertyManager()->GetNode(prop);
+	cmd.value = value;
+	if (!cmd.node) return 0;
+	return _commands.Push(cmd);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+unsigned JSBSimServer::Snapshot(vector<double>& values)
+{
+	if (!_snapshot) return 0;
+	values.resize(_snapshot->Size());
+	return _snapshot->Read(&values[0]);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void JSBSimServer::Loop(void)
+{
+	// runs on the sim thread: no MEX calls from here on
+	vector<double> frame(_watch.size() + 1);
+	PropertyCommand cmd;
+	while (!_quit.load(std::memory_order_acquire) && !_jii->IsStopped())
+	{
+		while (_commands.Pop(cmd))
+			cmd.node->setDoubleValue(cmd.value);
+
+		_jii->StepFDMExec();
+
+		frame[0] = _jii->fdmExec->GetSimTime();
+		for (size_t i=0; i<_watch.size(); i++)
+			frame[i+1] = _watch[i]->getDoubleValue();
+		_snapshot->Write(&frame[0]);
+
+		if (_jii->IsStopped()) break;
+
+		_pacer.Wait(1.0/_rate);
+	}
+	_stopped.store(true, std::memory_order_release);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -0,0 +1,60 @@
+#ifndef JSBSIMSERVER_HEADER_H
+#define JSBSIMSERVER_HEADER_H
+
+#include "JSBSimInterface.h"
+#include "JSBSimLockFree.h"
+#include "RealTimePacer.h"
+#include <thread>
+
+/// Free-running simulation of a loaded aircraft on a background thread
+/*
+	The sim thread runs one JSBSim frame per 1/rate_hz seconds of wall
+	clock time. Each frame it first applies the property commands queued
+	by Command(), then runs the FDM, then publishes the snapshot
+	[sim-time watched-properties...] that Snapshot() reads. The queue is
+	single producer (the Matlab thread) and the snapshot a sequence lock,
+	so neither side ever waits for the other. The thread ends by itself
+	when a stop condition of the interface holds; IsRunning() stays true
+	until Stop() joins it, HasStopped() tells it has finished.
+
+	Property names are resolved on the Matlab thread; the property tree
+	does not change shape once the aircraft is loaded. Nothing else may
+	touch the JSBSimInterface while the server runs.
+*/
+class JSBSimServer
+{
+public:
+	JSBSimServer(JSBSimInterface *jii);
+	~JSBSimServer(void);
+
+	/// Resolve the watch list and start the sim thread
+	bool Start(double rate_hz, const vector<string>& watch);
+	/// Stop and join the sim thread
+	void Stop(void);
+	bool IsRunning(){return _thread.joinable();}
+	bool HasStopped(){return _stopped.load(std::memory_order_acquire);}
+
+	/// Queue a property command for the next frame; false if unknown or the queue is full
+	bool Command(const string prop, double value);
+	/// Latest frame [sim-time watched...], returns the number of frames run
+	unsigned Snapshot(vector<double>& values);
+	/// Pacing statistics of the sim thread
+	RealTimePacer& GetPacer(){return _pacer;}
+
+private:
+	void Loop(void);
+
+	struct PropertyCommand { FGPropertyManager *node; double value; };
+
+	JSBSimInterface *_jii;
+	double _rate;
+	vector<FGPropertyManager*> _watch;
+	SPSCQueue<PropertyCommand, 1024> _commands;
+	SeqLockSnapshot *_snapshot;
+	RealTimePacer _pacer;
+	std::thread _thread;
+	std::atomic<bool> _quit;
+	std::atomic<bool> _stopped;
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
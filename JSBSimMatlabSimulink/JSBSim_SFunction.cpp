@@ -29,6 +29,71 @@
  * [throttle-cmd-norm aileron-cmd-norm elevator-cmd-norm rudder-cmd-norm mixture-cmd-norm set-running flaps-cmd-norm gear-cmd-norm],
  * [delta_T], 'verbosity'
  * Verbosity can either be set to 'Silent', 'Verbose', 'VeryVerbose' or 'Debug'
+ * An optional 7th parameter 'IC_options' is a structure array with fields name/value, in the same
+ * form as the MexJSBSim 'init' structure. Its entries are passed to JSBSimInterface::Init after the
+ * initial conditions, e.g. to select higher order integrators for a larger [delta_T] in fast-time runs:
+ *   opts(1).name = 'integrator/rate/rotational';    opts(1).value = 4; % Adams-Bashforth 3
+ *   opts(2).name = 'integrator/rate/translational'; opts(2).value = 4;
+ * See JSBSimInterface.h for the stability/accuracy table of the integrators.
+ * Setting 'adaptive/tolerance' > 0 (and optionally 'adaptive/min-substeps', 'adaptive/max-substeps')
+ * replaces the fixed multiplier by an adaptive number of JSBSim substeps per Simulink step; the
+ * Simulink step stays delta_T * multiplier long.
+ * 'rate/propulsion', 'rate/atmosphere', 'rate/auxiliary', 'rate/aerodynamics' and 'rate/massbalance'
+ * set how many JSBSim frames pass between runs of that model (outputs are held in between).
+ * Init spools the engines up to the commanded power before the first step, see SpoolUpEngines;
+ * 'spool-up/max-iterations' (0 = off) and 'spool-up/tolerance' tune it.
+ * 'realtime/factor' = 1 paces each Simulink step to the wall clock (2 = twice as fast), with
+ * 'realtime/cpu' (pin the JSBSim thread to a core), 'realtime/priority' (1..99, real-time scheduling)
+ * and 'realtime/spin-us' (busy-wait before each deadline). Misses and jitter are printed at the end.
+ * The core and priority need 'sfun/pipelined' = 1: Matlab's own thread is never pinned or raised.
+ * Entries starting with 'sfun/' are read by the S-function itself:
+ *   'sfun/propulsion-rate', 'sfun/calculated-rate'  update the propulsion / calculated output ports only
+ *                                                   every n-th JSBSim frame (default 1)
+ *   'sfun/pipelined'                                1 runs each JSBSim frame on a worker thread while Simulink
+ *                                                   evaluates the rest of the diagram; all outputs then lag the
+ *                                                   inputs by one frame and JSBSim output is silenced
+ *   'sfun/shm-name'                                 a name such as '/jsbsim_c172' publishes every frame's states,
+ *                                                   flight control and calculated outputs, with their names, to that
+ *                                                   shared-memory segment, which must not exist yet; the frame time is
+ *                                                   JSBSim's sim-time; see ShmPublisher.h for the layout
+ *   'sfun/mat-file'                                 a file such as 'run42.mat' receives every frame's states and
+ *                                                   gathered outputs, written as a MAT-file when the simulation
+ *                                                   ends; see JSBSimInterface::OpenMatFile for the variables
+ *   'sfun/journal'                                  a file such as 'run42.jrn' records the init, the inputs of every
+ *                                                   frame and a state hash every 'sfun/journal-every' frames (100);
+ *                                                   MexJSBSim('replay', file) re-runs it without Simulink
+ *   'sfun/checkpoint-out', 'sfun/checkpoint-in'     save the simulation state to that file when the simulation ends,
+ *                                                   or start from a saved one instead of the IC (same aircraft and dt);
+ *                                                   see JSBSimInterface::TakeSnapshot for what is not carried over
+ * Flight control, propulsion and calculated outputs are only gathered from JSBSim when their port is
+ * connected (and, for the slower ports, on the frames they sample).
+ * An optional 8th parameter 'IC_signal_map' names a signal map file (pass [] as IC_options if unused).
+ * It lists the property paths, and optionally units, of the flight control, propulsion and calculated
+ * output ports; those ports are then sized to their list and filled from property nodes resolved once
+ * when the aircraft is loaded. See JISignalMap in JSBSimInterface.h for the format, e.g.
+ *   output 3 velocities/vc-kts
+ *   output 3 attitude/theta-rad deg
+ * The map can also replace the 8 control inputs by its own list of input properties; a [*] in the
+ * path sets that property on every engine:
+ *   input fcs/throttle-cmd-norm[*]
+ *   input fcs/speedbrake-cmd-norm
+ * and stream a set of properties as UDP or Unix datagrams to local tools, every n-th frame:
+ *   stream velocities/vc-kts
+ *   stream-to udp:127.0.0.1:5500
+ *   stream-every 4
+ * Stop conditions end the simulation as soon as one holds after a JSBSim step; the condition and
+ * its sim time are printed at the end:
+ *   stop gear/wow > 0
+ *   stop position/h-agl-ft < 50
+ *   stop nan
+ * and keep running statistics of properties, printed at the end (quantiles, then a threshold):
+ *   stat accelerations/Nz q 0.5 0.99 > 3.8
+ * 'record' lines keep a compressed history of properties after every JSBSim step ('record-every n' for
+ * every n-th), left in the base workspace as JSBSim_history = [sim-time recorded...] at the end:
+ *   record gear/gear-pos-norm
+ *   record position/h-sl-ft m
+ * Sample times are port based: the input port and the state and flight control output ports run at
+ * the discrete JSBSim frame rate delta_T * multiplier, the two slower ports at a multiple of it.
  * The model currently takes 8 control inputs:throttle, aileron, elevator, rudder, mixture, set-running, flaps and gear.
  * The model has 12 states:[u-fps v-fps w-fps p-rad-sec q-rad-sec r-rad-sec h-sl-ft long-deg lat-deg phi-rad theta-rad psi-rad] 
  * Model has 4 output ports: state vector, control output vector, propulsion output vector and calculated output vector.
@@ -76,12 +141,15 @@
 #include "matrix.h"
 #include <iostream>
 #include <string>
+#include <string.h>
 #include <vector>
 #include <FGFDMExec.h>
 #include <models/FGPropagate.h>
 #include <models/FGAuxiliary.h>
 #include <models/FGFCS.h>
 #include <JSBSimInterface.h>
+#include <JSBSimPipeline.h>
+#include <ShmPublisher.h>
 
 
 // 12 States of Initial Condition Vector
@@ -116,12 +184,25 @@
 #define verbosity			ssGetSFcnParam(S, 4) //Verbosity parameter
 #define ac_name				ssGetSFcnParam(S, 0) //Name of JSBSim aircraft model file to load
 #define multiplier			mxGetPr(ssGetSFcnParam(S, 5))[0] //JSBSim multiplier
+#define sim_options			(ssGetSFcnParamsCount(S) > 6 ? ssGetSFcnParam(S, 6) : NULL) //Optional name/value structure
+#define signal_map_file		(ssGetSFcnParamsCount(S) > 7 ? ssGetSFcnParam(S, 7) : NULL) //Optional signal map file name
 
-// Necessary to create mxArray of initial conditions 
+#define NUM_REQUIRED_PARAMS	6
+#define NUM_OPTIONAL_PARAMS	2
+
+// Number of initial conditions in the ic[] list
 #define NUMBER_OF_STRUCTS (sizeof(ic)/sizeof(struct init_cond))
-#define NUMBER_OF_FIELDS (sizeof(field_names)/sizeof(*field_names))
 
-JSBSim::FGFDMExec FDMExec;	// Instantiate new JSBSim FDMExec object
+/* Each block creates its own JSBSim FDMExec object in mdlInitializeConditions (PWork[1]),
+ * so several aircraft can fly in the same diagram. PWork[2] holds the worker of the
+ * pipelined mode and PWork[3] the shared-memory publisher, NULL when not used.
+ */
+
+/* Integer work vector */
+#define IWORK_CONNECTED		0	// output groups whose ports are connected
+#define IWORK_PROP_RATE		1	// propulsion port divider
+#define IWORK_CALC_RATE		2	// calculated outputs port divider
+#define IWORK_FRAME			3	// JSBSim frames completed
 
 struct init_cond
 		{
@@ -157,6 +238,92 @@ struct verbosity_level
  * See matlabroot/simulink/src/sfuntmpl_doc.c for more details.
  */
 
+/* Function: GetSimOption =====================================================
+ * Abstract:
+ *    Looks up a numeric entry of the optional IC_options structure.
+ *    Returns def when IC_options or the entry is not present.
+ */
+static double GetSimOption(SimStruct *S, const char *name, double def)
+{
+    const mxArray *opts = sim_options;
+    if (opts == NULL || mxIsEmpty(opts)) return def;
+
+    for (mwIndex i=0; i<mxGetNumberOfElements(opts); i++) {
+        const mxArray *n = mxGetField(opts,i,"name");
+        const mxArray *v = mxGetField(opts,i,"value");
+        char buf[128];
+        if (n != NULL && v != NULL && mxIsChar(n) && mxIsNumeric(v) &&
+            mxGetString(n,buf,sizeof(buf)) == 0 && strcmp(buf,name) == 0)
+            return mxGetScalar(v);
+    }
+    return def;
+}
+
+/* Function: GetSimOptionString ===============================================
+ * Abstract:
+ *    Looks up a string entry of the optional IC_options structure.
+ *    Returns false when IC_options or the entry is not present.
+ */
+static bool GetSimOptionString(SimStruct *S, const char *name, char *value, int len)
+{
+    const mxArray *opts = sim_options;
+    if (opts == NULL || mxIsEmpty(opts)) return false;
+
+    for (mwIndex i=0; i<mxGetNumberOfElements(opts); i++) {
+        const mxArray *n = mxGetField(opts,i,"name");
+        const mxArray *v = mxGetField(opts,i,"value");
+        char buf[128];
+        if (n != NULL && v != NULL && mxIsChar(n) && mxIsChar(v) &&
+            mxGetString(n,buf,sizeof(buf)) == 0 && strcmp(buf,name) == 0)
+            return mxGetString(v,value,len) == 0;
+    }
+    return false;
+}
+
+/* Function: IsSFunctionOption ================================================
+ * Abstract:
+ *    True for IC_options entries meant for the S-function ('sfun/...'),
+ *    these are not passed on to JSBSimInterface::Init.
+ */
+static bool IsSFunctionOption(const mxArray *opts, mwIndex i)
+{
+    const mxArray *n = mxGetField(opts,i,"name");
+    char buf[128];
+    return (n != NULL && mxIsChar(n) && mxGetString(n,buf,sizeof(buf)) == 0 &&
+            strncmp(buf,"sfun/",5) == 0);
+}
+
+/* Function: GetSignalMap =====================================================
+ * Abstract:
+ *    Reads the optional IC_signal_map file. An absent or empty parameter
+ *    gives an empty map, i.e. the built-in port layouts.
+ */
+static bool GetSignalMap(SimStruct *S, JISignalMap &map)
+{
+    static char msg[256];
+    const mxArray *file = signal_map_file;
+    if (file == NULL || mxIsEmpty(file)) return true;
+
+    char buf[512];
+    if (!mxIsChar(file) || mxGetString(file,buf,sizeof(buf)) != 0) {
+        ssSetErrorStatus(S,"IC_signal_map must be the name of a signal map file.");
+        return false;
+    }
+    string error;
+    if (!JSBSimInterface::ReadSignalMap(buf, map, error)) {
+        sprintf(msg, "%.255s", error.c_str());
+        ssSetErrorStatus(S,msg);
+        return false;
+    }
+    return true;
+}
+
+/* Sample time of the JSBSim frame and the dividers of the slower output ports */
+#define fdm_sample_time		(delta_t * multiplier)
+#define propulsion_rate		((int)GetSimOption(S,"sfun/propulsion-rate",1))
+#define calculated_rate		((int)GetSimOption(S,"sfun/calculated-rate",1))
+#define pipelined			(GetSimOption(S,"sfun/pipelined",0) != 0)
+
 /*====================*
  * S-function methods *
  *====================*/
@@ -169,18 +336,35 @@ struct verbosity_level
 static void mdlInitializeSizes(SimStruct *S)
 {
   /* See sfuntmpl_doc.c for more details on the macros below */
-    ssSetNumSFcnParams(S, 6);  /* Number of expected parameter vectors*/
-    if (ssGetNumSFcnParams(S) != ssGetSFcnParamsCount(S)) {
-        /* Return if number of expected != number of actual parameters */
+    ssSetNumSFcnParams(S, -1);  /* 6 required parameter vectors plus the optional IC_options */
+    if ((ssGetSFcnParamsCount(S) < NUM_REQUIRED_PARAMS) ||
+        (ssGetSFcnParamsCount(S) > NUM_REQUIRED_PARAMS + NUM_OPTIONAL_PARAMS)) {
+        ssSetErrorStatus(S,"JSBSim_SFunction expects 6 parameters, an optional IC_options structure and IC_signal_map file.");
+        return;
+    }
+    if (sim_options != NULL && !mxIsEmpty(sim_options) &&
+        (!mxIsStruct(sim_options) || mxGetFieldNumber(sim_options,"name") < 0 || mxGetFieldNumber(sim_options,"value") < 0)) {
+        ssSetErrorStatus(S,"IC_options must be a structure array with fields 'name' and 'value'.");
         return;
     }
+    if (fdm_sample_time <= 0.0 || propulsion_rate < 1 || calculated_rate < 1) {
+        ssSetErrorStatus(S,"delta_T * multiplier must be positive and the output port rates at least 1.");
+        return;
+    }
+    /* the sample times are derived from the parameters, so none of them is tunable */
+    for (int p = 0; p < ssGetSFcnParamsCount(S); p++)
+        ssSetSFcnParamTunable(S, p, 0);
 
     //ssSetNumContStates(S, 12);
     ssSetNumDiscStates(S, 12);
 
+    /* port widths follow the signal map, if one is given */
+    JISignalMap map;
+    if (!GetSignalMap(S, map)) return;
+
     /* if (!ssSetNumInputPorts(S, 1)) return; */
 	ssSetNumInputPorts(S, 1);
-    ssSetInputPortWidth(S, 0, 8);//[thr ail el rud mxtr run flap gear]
+    ssSetInputPortWidth(S, 0, JSBSimInterface::GetInputWidth(map));//[thr ail el rud mxtr run flap gear] or the mapped inputs
     /* ssSetInputPortRequiredContiguous(S, 0, true); /*direct input signal access*/
     /*
      * Set direct feedthrough flag (1=yes, 0=no).
@@ -196,21 +380,35 @@ static void mdlInitializeSizes(SimStruct *S)
 	/* Flight Controls output [thr-pos-norm left-ail-pos-rad el-pos-rad tvc-pos-rad rud-pos-rad flap-pos-norm right-ail-pos-rad 
 	 * speedbrake-pos-rad spoiler-pos-rad lef-pos-rad gear-pos-norm Nose-gear-steering-pos-deg gear-unit-WOW]
 	 */
-	ssSetOutputPortWidth(S, 1, 13);
+	ssSetOutputPortWidth(S, 1, JSBSimInterface::GetOutputWidth(map, 1));
 
 	/* Propulsion output piston (per engine) [prop-rpm prop-thrust-lbs mixture fuel-flow-gph advance-ratio power-hp pt-lbs_sqft 
 	 * volumetric-efficiency bsfc-lbs_hphr prop-torque blade-angle prop-pitch]
 	 * Propulsion output turbine (per engine) [thrust-lbs n1 n2 fuel-flow-pph fuel-flow-pps pt-lbs_sqft pitch-rad reverser-rad yaw-rad inject-cmd 
 	 * set-running fuel-dump]
 	 */
-	ssSetOutputPortWidth(S, 2, 48);
+	ssSetOutputPortWidth(S, 2, JSBSimInterface::GetOutputWidth(map, 2));
 		
 
-	ssSetOutputPortWidth(S, 3, 11);//Calculated outputs [pilot-Nz alpha alpha-dot beta beta-dot vc-fps vc-kts 
+	ssSetOutputPortWidth(S, 3, JSBSimInterface::GetOutputWidth(map, 3));//Calculated outputs [pilot-Nz alpha alpha-dot beta beta-dot vc-fps vc-kts 
  						           //					 Vt-fps vg-fps mach climb-rate]    
 	//ssSetOutputPortWidth(S, 4, 12);//JSBSim Calculated States output [u v w p q r q1 q2 q3 q4 long-deg lat-deg z-ft phi theta psi h-ft alpha beta]
 
-	//ssSetNumSampleTimes(S, 1);
+	/* Port based sample times: JSBSim frame rate on the input, state and flight control ports,
+	 * optionally slower rates on the propulsion and calculated output ports.
+	 */
+	ssSetNumSampleTimes(S, PORT_BASED_SAMPLE_TIMES);
+	ssSetInputPortSampleTime(S, 0, fdm_sample_time);
+	ssSetInputPortOffsetTime(S, 0, 0.0);
+	ssSetOutputPortSampleTime(S, 0, fdm_sample_time);
+	ssSetOutputPortOffsetTime(S, 0, 0.0);
+	ssSetOutputPortSampleTime(S, 1, fdm_sample_time);
+	ssSetOutputPortOffsetTime(S, 1, 0.0);
+	ssSetOutputPortSampleTime(S, 2, fdm_sample_time * propulsion_rate);
+	ssSetOutputPortOffsetTime(S, 2, 0.0);
+	ssSetOutputPortSampleTime(S, 3, fdm_sample_time * calculated_rate);
+	ssSetOutputPortOffsetTime(S, 3, 0.0);
+
     if(!ssSetNumDWork(   S, 6)) return;
 
     ssSetDWorkWidth(     S, 0, ssGetInputPortWidth(S,0));//Work vector for input port
@@ -232,12 +430,13 @@ static void mdlInitializeSizes(SimStruct *S)
     ssSetDWorkDataType(  S, 5, SS_DOUBLE);	
 
 
-	ssSetNumPWork(S, 1); // reserve element in the pointers vector
-                         // to store a C++ object
+	ssSetNumPWork(S, 4); // reserve elements in the pointers vector
+                         // to store the JSBSimInterface, FGFDMExec, JSBSimPipeline and ShmPublisher objects
+	ssSetNumIWork(S, 4);
 
     ssSetNumNonsampledZCs(S, 0);
 
-    ssSetOptions(S, 0);
+    ssSetOptions(S, SS_OPTION_PORT_SAMPLE_TIMES_ASSIGNED);
 		
 }
 
@@ -246,14 +445,13 @@ static void mdlInitializeSizes(SimStruct *S)
 /* Function: mdlInitializeSampleTimes =========================================
  * Abstract:
  *    This function is used to specify the sample time(s) for your
- *    S-function. You must register the same number of sample times as
- *    specified in ssSetNumSampleTimes.
+ *    S-function. The sample times are port based and have already been
+ *    assigned to the ports in mdlInitializeSizes, JSBSim runs at the discrete
+ *    rate delta_T * multiplier so there are no minor time steps.
  */
 static void mdlInitializeSampleTimes(SimStruct *S)
 {
-    ssSetSampleTime(S, 0, CONTINUOUS_SAMPLE_TIME);
-    ssSetOffsetTime(S, 0, 0.0);
-
+    UNUSED_ARG(S);
 }
 
 
@@ -277,7 +475,17 @@ static void mdlInitializeSampleTimes(SimStruct *S)
 		   also create a pointer to the JSBSimInterface object so we can access its member
 		   functions.
 		*/
-	    ssGetPWork(S)[0] = (void *) new JSBSimInterface(&FDMExec, delta_t);// IC parameter 4 passed here!
+		if (ssGetPWork(S)[0] != NULL) { // reset of an enabled subsystem, start from a fresh FDMExec
+			delete (JSBSimPipeline *) ssGetPWork(S)[2]; // joins the worker first
+			ssGetPWork(S)[2] = NULL;
+			delete (ShmPublisher *) ssGetPWork(S)[3];
+			ssGetPWork(S)[3] = NULL;
+			delete (JSBSimInterface *) ssGetPWork(S)[0];
+			delete (JSBSim::FGFDMExec *) ssGetPWork(S)[1];
+		}
+		ssGetPWork(S)[1] = (void *) new JSBSim::FGFDMExec();
+	    ssGetPWork(S)[0] = (void *) new JSBSimInterface((JSBSim::FGFDMExec *) ssGetPWork(S)[1], delta_t);// IC parameter 4 passed here!
+		ssGetIWork(S)[IWORK_FRAME] = 0;
 		JSBSimInterface *JII = (JSBSimInterface *) ssGetPWork(S)[0];   // retrieve C++ object pointers vector
 		//*********************************************************************************************//
 		/* create an mxStructureArray to set the verbosity */
@@ -323,10 +531,15 @@ static void mdlInitializeSampleTimes(SimStruct *S)
 		mxGetString(ac_name, buf, buflen);
 		string aircraft = "";
 		aircraft = string(buf);
+		JISignalMap map;
+		if (!GetSignalMap(S, map)) return;
+		JII->SetSignalMap(map); // resolved to property nodes by Open
 		if(!JII->Open(aircraft))
 		{
 			mexPrintf("Aircraft file could not be loaded.\n");
 			mexPrintf("\n");
+			ssSetErrorStatus(S,"JSBSim could not load the aircraft or resolve its signal map.");
+			return;
 		}
 		
 		else
@@ -345,32 +558,91 @@ static void mdlInitializeSampleTimes(SimStruct *S)
 
 		
 
-		/* create an mxStructureArray to recreate the initial conditions in test_1.m */
-		const char *field_names[] = {"name", "value"};
+		/* initial conditions and the IC_options entries for JSBSimInterface ('sfun/...' ones are
+		   handled here), resolved to setters and applied in one numeric Init */
 		struct init_cond ic[] = {{"u-fps", u_fps},{"v-fps", v_fps},{"w-fps", w_fps},{"p-rad_sec", p_radsec},{"q-rad_sec", q_radsec},{"r-rad_sec", r_radsec},
 		{"h-sl-ft", h_sl_ft},{"long-gc-deg", long_gc_deg},{"lat-gc-deg", lat_gc_deg},{"phi-rad", phi_rad},{"theta-rad", theta_rad},{"psi-rad", psi_rad},
 		{"fcs/throttle-cmd-norm", throttle}, {"aileron-cmd-norm", aileron}, {"elevator-cmd-norm", elevator}, {"rudder-cmd-norm", rudder}, 
 		{"fcs/mixture-cmd-norm", mixture}, {"set-running", runset}, {"flaps-cmd-norm", flaps}, {"gear-cmd-norm", gear}, {"multiplier", multiplier}};
-		mwSize dims[2] = {1,NUMBER_OF_STRUCTS};
-		int name_field, value_field;
+		vector<string> ic_names;
+		vector<double> ic_values;
 		mwIndex i;
-		//mxArray *prhs[1];
-		prhs[0] = mxCreateStructArray(2, dims, NUMBER_OF_FIELDS, field_names);
-		name_field = mxGetFieldNumber(prhs[0],"name");
-        value_field = mxGetFieldNumber(prhs[0],"value");
 		for (i=0; i<NUMBER_OF_STRUCTS; i++) {
-			mxArray *field_value;
-			/* Use mxSetFieldByNumber instead of mxSetField for efficiency
-			mxSetField(plhs[0],i,"name",mxCreateString(friends[i].name); */
-			mxSetFieldByNumber(prhs[0],i,name_field,mxCreateString(ic[i].name));
-			field_value = mxCreateDoubleMatrix(1,1,mxREAL);
-			*mxGetPr(field_value) = ic[i].value;
-			/* Use mxSetFieldByNumber instead of mxSetField for efficiency
-			mxSetField(plhs[0],i,"name",mxCreateString(friends[i].name); */
-			mxSetFieldByNumber(prhs[0],i,value_field,field_value);
+			ic_names.push_back(ic[i].name);
+			ic_values.push_back(ic[i].value);
+			}
+		/* append the optional name/value entries, e.g. integrator selection */
+		if (sim_options != NULL)
+			for (i=0; i<mxGetNumberOfElements(sim_options); i++) {
+				const mxArray *n = mxGetField(sim_options,i,"name");
+				const mxArray *v = mxGetField(sim_options,i,"value");
+				char o_buf[128];
+				if (IsSFunctionOption(sim_options,i) || n == NULL || v == NULL || !mxIsNumeric(v) ||
+					mxGetString(n,o_buf,sizeof(o_buf)) != 0) continue;
+				ic_names.push_back(o_buf);
+				ic_values.push_back(mxGetScalar(v));
+			}
+			/* journal the init and every step's inputs for MexJSBSim('replay', file) */
+			char journal_file[256];
+			if (GetSimOptionString(S, "sfun/journal", journal_file, sizeof(journal_file))) {
+				if (!JII->StartJournal(journal_file, (int)GetSimOption(S,"sfun/journal-every",100))) {
+					ssSetErrorStatus(S,"The journal of 'sfun/journal' could not be created.");
+					return;
+				}
+				mexPrintf("Journaling the inputs to '%s'.\n", journal_file);
+			}
+			JIInitList ic_list;
+			JII->ResolveInitList(ic_names, ic_list);
+			JII->Init(ic_list, &ic_values[0]);
+			/* warm start: the saved state replaces the one just initialized */
+			char checkpoint_file[256];
+			if (GetSimOptionString(S, "sfun/checkpoint-in", checkpoint_file, sizeof(checkpoint_file))) {
+				if (!JII->LoadCheckpoint(checkpoint_file)) {
+					ssSetErrorStatus(S,"The checkpoint of 'sfun/checkpoint-in' could not be loaded.");
+					return;
+				}
+				mexPrintf("Warm start from checkpoint '%s' at sim-time %f s.\n", checkpoint_file, JII->fdmExec->GetSimTime());
 			}
-			JII->Init(prhs[0]);
 		 //mexPrintf("After JI->Init.\n");		 
+
+		/* stream the outputs to part files, the MAT-file is written at mdlTerminate */
+		char mat_file[256];
+		if (GetSimOptionString(S, "sfun/mat-file", mat_file, sizeof(mat_file))) {
+			if (!JII->OpenMatFile(mat_file)) {
+				ssSetErrorStatus(S,"The MAT-file of 'sfun/mat-file' could not be created.");
+				return;
+			}
+			mexPrintf("Writing the outputs to MAT-file '%s'.\n", mat_file);
+		}
+
+		/* from here on UpdateStates runs on the worker thread, which must stay silent */
+		if (pipelined) {
+			mexPrintf("Pipelined stepping: outputs lag the inputs by one frame, JSBSim output is silenced.\n");
+			ssGetPWork(S)[2] = (void *) new JSBSimPipeline(JII, ssGetDWorkWidth(S,0), ssGetDWorkWidth(S,1),
+				ssGetDWorkWidth(S,3), ssGetDWorkWidth(S,4), ssGetDWorkWidth(S,5));
+		}
+
+		/* publish states, flight control and calculated outputs to shared memory */
+		char shm_name[128];
+		if (GetSimOptionString(S, "sfun/shm-name", shm_name, sizeof(shm_name))) {
+			vector<string> signals, names;
+			JSBSimInterface::GetOutputNames(map, JSBSimInterface::eStatePort, signals);
+			JSBSimInterface::GetOutputNames(map, JSBSimInterface::eFCSPort, names);
+			signals.insert(signals.end(), names.begin(), names.end());
+			JSBSimInterface::GetOutputNames(map, JSBSimInterface::eCalculatedPort, names);
+			signals.insert(signals.end(), names.begin(), names.end());
+			ShmPublisher *shm = new ShmPublisher();
+			if (!shm->Open(shm_name, signals)) {
+				bool taken = shm->WasNameTaken();
+				delete shm;
+				ssSetErrorStatus(S, taken ?
+					"The shared-memory name of 'sfun/shm-name' is already in use by another block or process." :
+					"The shared-memory segment of 'sfun/shm-name' could not be created.");
+				return;
+			}
+			ssGetPWork(S)[3] = (void *) shm;
+			mexPrintf("Publishing %d signals to shared memory '%s'.\n", (int)signals.size(), shm_name);
+		}
 	  
   }
 #endif /* MDL_INITIALIZE_CONDITIONS */
@@ -404,7 +676,21 @@ static void mdlInitializeSampleTimes(SimStruct *S)
 		x2[11] = psi_rad;
 		//x[12] = alpha_rad;
 		//x[13] = beta_rad;
-		
+
+		ssGetPWork(S)[0] = NULL; // created in mdlInitializeConditions
+		ssGetPWork(S)[1] = NULL;
+		ssGetPWork(S)[2] = NULL;
+		ssGetPWork(S)[3] = NULL;
+
+		/* Only the output groups whose ports are wired up are gathered by JSBSimInterface */
+		int_T *iw = ssGetIWork(S);
+		iw[IWORK_CONNECTED] =
+			(ssGetOutputPortConnected(S,1) ? JSBSimInterface::eFCSOutputs : 0) |
+			(ssGetOutputPortConnected(S,2) ? JSBSimInterface::ePropulsionOutputs : 0) |
+			(ssGetOutputPortConnected(S,3) ? JSBSimInterface::eCalculatedOutputs : 0);
+		iw[IWORK_PROP_RATE] = propulsion_rate;
+		iw[IWORK_CALC_RATE] = calculated_rate;
+		iw[IWORK_FRAME] = 0;
   }
 #endif /*  MDL_START */
 
@@ -453,20 +739,25 @@ static void mdlOutputs(SimStruct *S, int_T tid)
 		y1[i] = x[i]; // outputs are the states 
 	 }
 */
+	/* each port is only written on its own sample hit */
+	if (ssIsSampleHit(S, ssGetOutputPortSampleTimeIndex(S,0), tid))
 	for (i = 0; i < ssGetNumDiscStates(S); i++)
 	 {
 		y1[i] = x2[i]; /* outputs are the states */
 	 }
 
+	if (ssIsSampleHit(S, ssGetOutputPortSampleTimeIndex(S,1), tid))
 	for (i = 0; i < ssGetDWorkWidth(S,3); i++)
 	 {
 		y2[i] = w3[i]; // outputs are the flight control outputs 
 	 }
 
+	if (ssIsSampleHit(S, ssGetOutputPortSampleTimeIndex(S,2), tid))
 	for (i = 0; i < ssGetDWorkWidth(S,4); i++)
 	 {
 		y3[i] = w4[i]; // outputs are the propulsion outputs 
 	 }
+	if (ssIsSampleHit(S, ssGetOutputPortSampleTimeIndex(S,3), tid))
 	for (i = 0; i < ssGetDWorkWidth(S,5); i++)
 	 {
 		y4[i] = w5[i]; // outputs are the calculated outputs 
@@ -491,6 +782,9 @@ static void mdlOutputs(SimStruct *S, int_T tid)
 	   retrieve state vector, and update sim state vector 
 	  */
 	  //mexPrintf("Before JII pointer object creation.\n");
+	 /* JSBSim only steps on the frame rate hit, the slower ports have no updates of their own */
+	 if (!ssIsSampleHit(S, ssGetInputPortSampleTimeIndex(S,0), tid)) return;
+
 	 JSBSimInterface *JII = (JSBSimInterface *) ssGetPWork(S)[0];   // retrieve C++ object pointers vector
 	 //mexPrintf("After JII pointer creation.\n");
 	 real_T *x2 = ssGetRealDiscStates(S);
@@ -509,6 +803,16 @@ static void mdlOutputs(SimStruct *S, int_T tid)
 	 for (k=0; k < ssGetDWorkWidth(S,1); k++) {
         states[k] = x2[k];
      }
+	 /* gather a group only if its port is connected and samples the result of this frame */
+	 int_T *iw = ssGetIWork(S);
+	 int frame = ++iw[IWORK_FRAME];
+	 int groups = iw[IWORK_CONNECTED];
+	 JSBSimPipeline *pipe = (JSBSimPipeline *) ssGetPWork(S)[2];
+	 if (pipe != NULL) frame++; // the frame started now is collected, and sampled, one step later
+	 if (frame % iw[IWORK_PROP_RATE] != 0) groups &= ~JSBSimInterface::ePropulsionOutputs;
+	 if (frame % iw[IWORK_CALC_RATE] != 0) groups &= ~JSBSimInterface::eCalculatedOutputs;
+	 ShmPublisher *shm = (ShmPublisher *) ssGetPWork(S)[3];
+	 if (shm != NULL) groups |= JSBSimInterface::eFCSOutputs | JSBSimInterface::eCalculatedOutputs; // published every frame
 	 /*
 	 mexPrintf("Before JII->UpdateStates.\n");
 	 //If integrator override flag is 1, then integrate in Simulink, else integrate in JSBSim
@@ -522,9 +826,38 @@ static void mdlOutputs(SimStruct *S, int_T tid)
 	 JII->UpdateStates(inputs, states, controls, propulsion, outputs); // call to JSBSimInterface to get updated states from JSBSim  
 	 //mexPrintf("After JII->UpdateStates.\n");
 	 */
+	 /* a stop condition of the signal map ends the simulation, read before the worker gets JII back */
+	 bool stopped;
+	 double frame_time; /* JSBSim's sim-time of the states written below */
+	 if (pipe != NULL) {
+		 /* take over the frame started last step, then start this one and return at once */
+		 bool collected = pipe->Collect(states, controls, propulsion, outputs);
+		 if (pipe->Failed()) {
+			 ssSetErrorStatus(S,"JSBSim failed on the pipeline worker thread.");
+			 return;
+		 }
+		 stopped = JII->IsStopped();
+		 frame_time = pipe->GetSimTime();
+		 pipe->Start(inputs, groups);
+		 if (!collected) return; // first frame, the states keep their initial values
+	 }
+	 else {
+	 JII->SetOutputGroups(groups); // the pipeline's worker sets them itself, for the frame it runs
+	 JII->UpdateStates(inputs, states, controls, propulsion, outputs); // JSBSim integrates, one Simulink frame
+	 stopped = JII->IsStopped();
+	 frame_time = JII->fdmExec->GetSimTime();
+	 }
+	 if (stopped) ssSetStopRequested(S, 1);
 	for (k=0; k < ssGetDWorkWidth(S,1); k++) {
         x2[k] = states[k];
     } 
+	if (shm != NULL) {
+		shm->BeginFrame(frame_time);
+		shm->Write(0, states, ssGetDWorkWidth(S,1));
+		shm->Write(ssGetDWorkWidth(S,1), controls, ssGetDWorkWidth(S,3));
+		shm->Write(ssGetDWorkWidth(S,1) + ssGetDWorkWidth(S,3), outputs, ssGetDWorkWidth(S,5));
+		shm->EndFrame();
+	}
 	/* for (k=0; k < ssGetDWorkWidth(S,2); k++) {
         dx[k] = derivatives[k];
     }*/
@@ -565,8 +898,77 @@ static void mdlTerminate(SimStruct *S)
 {
 	
 	JSBSimInterface *JII = (JSBSimInterface *) ssGetPWork(S)[0];   // retrieve C++ object pointers vector
-	JII->ResetToInitialCondition();
-	JII->~JSBSimInterface();
+	if (JII != NULL) {
+		delete (JSBSimPipeline *) ssGetPWork(S)[2]; // joins the worker before JII goes away
+		ssGetPWork(S)[2] = NULL;
+		delete (ShmPublisher *) ssGetPWork(S)[3]; // removes the segment
+		ssGetPWork(S)[3] = NULL;
+		if (JII->IsRealTime()) {
+			RealTimePacer& pacer = JII->GetPacer();
+			mexPrintf("\nReal-time pacing: %ld frames, %ld deadline misses (worst %.1f us late)\n",
+				pacer.GetFrames(), pacer.GetMisses(), pacer.GetMaxOverrun()*1.0e6);
+			mexPrintf("Wake-up jitter: mean %.1f us, rms %.1f us, max %.1f us\n",
+				pacer.GetMeanJitter()*1.0e6, pacer.GetRMSJitter()*1.0e6, pacer.GetMaxJitter()*1.0e6);
+			if (!pacer.ThreadSettingsApplied())
+				mexPrintf("CPU pinning or real-time priority could not be applied.\n");
+		}
+		if (JII->IsStopped())
+			mexPrintf("\nStopped at sim-time %f s by condition %d: %s\n", JII->GetStopTime(),
+				JII->GetStopReason(), JII->GetStopCondition(JII->GetStopReason()).c_str());
+		if (JII->GetJournal().IsRecording()) {
+			mexPrintf("\nJournal: %lu frames recorded\n", (unsigned long) JII->GetJournal().GetSteps());
+			JII->StopJournal();
+		}
+		MatFileWriter& mat = JII->GetMatFile();
+		if (mat.IsOpen()) {
+			string mat_file = mat.GetFileName();
+			unsigned long frames = (unsigned long) mat.GetRows(0);
+			if (JII->CloseMatFile())
+				mexPrintf("\nWrote %lu frames to MAT-file '%s'\n", frames, mat_file.c_str());
+			else
+				mexPrintf("\nMAT-file '%s' could not be written completely.\n", mat_file.c_str());
+		}
+		HistoryBuffer& history = JII->GetHistory();
+		if (history.GetLength() > 0) {
+			/* decoded once, into the base workspace */
+			mwSize n = history.GetLength();
+			mxArray *h = mxCreateDoubleMatrix(n, history.GetNumSignals() + 1, mxREAL);
+			history.DecodeTime(mxGetPr(h));
+			for (int i=0; i<history.GetNumSignals(); i++)
+				history.DecodeSignal(i, mxGetPr(h) + (i+1)*n);
+			mexPutVariable("base", "JSBSim_history", h);
+			mxDestroyArray(h);
+			mexPrintf("\nJSBSim_history: %lu steps of [sim-time", (unsigned long) n);
+			for (unsigned i=0; i<JII->GetRecordNames().size(); i++)
+				mexPrintf(" %s", JII->GetRecordNames()[i].c_str());
+			mexPrintf("], kept in %.1f kB instead of %.1f kB\n",
+				history.GetBytes()/1024.0, history.GetRawBytes()/1024.0);
+		}
+		const vector<JIStatistic>& statistics = JII->GetStatistics();
+		for (unsigned i=0; i<statistics.size(); i++) {
+			const SignalStats& st = statistics[i].stats;
+			mexPrintf("\n%s\n  mean %g, std %g, min %g at %g s, max %g at %g s (%lu samples)\n",
+				statistics[i].spec.c_str(), st.GetMean(), st.GetStd(), st.GetMin(), st.GetMinTime(),
+				st.GetMax(), st.GetMaxTime(), st.GetCount());
+			for (int k=0; k<st.GetNumQuantiles(); k++)
+				mexPrintf("  q%g %g\n", st.GetQuantileP(k), st.GetQuantile(k));
+			if (st.HasThreshold())
+				mexPrintf("  beyond %g: %lu samples, %lu excursions, %g s\n", st.GetThreshold(),
+					st.GetExceedances(), st.GetExceedanceEvents(), st.GetExceedanceTime());
+		}
+		char checkpoint_file[256];
+		if (GetSimOptionString(S, "sfun/checkpoint-out", checkpoint_file, sizeof(checkpoint_file))) {
+			if (JII->SaveCheckpoint(checkpoint_file))
+				mexPrintf("\nCheckpoint at sim-time %f s saved to '%s'\n", JII->fdmExec->GetSimTime(), checkpoint_file);
+			else
+				mexPrintf("\nCheckpoint '%s' could not be saved.\n", checkpoint_file);
+		}
+		JII->ResetToInitialCondition();
+		delete JII;
+		delete (JSBSim::FGFDMExec *) ssGetPWork(S)[1];
+		ssGetPWork(S)[0] = NULL;
+		ssGetPWork(S)[1] = NULL;
+	}
 	mexPrintf("\n");
 	mexPrintf("Simulation completed.\n");
 	mexPrintf("\n");
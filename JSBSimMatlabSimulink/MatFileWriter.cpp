@@ -0,0 +1,209 @@
+#include "StdAfx.h"
+#include "MatFileWriter.h"
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <algorithm>
+
+// Level 5 MAT-file data types and array classes
+enum MatDataType {eMiInt8=1, eMiUInt16=4, eMiInt32=5, eMiUInt32=6, eMiDouble=9, eMiMatrix=14};
+enum MatArrayClass {eMxChar=4, eMxDouble=6};
+
+static int Seek(FILE *f, long long pos)
+{
+#ifdef _WIN32
+	return _fseeki64(f, pos, SEEK_SET);
+#else
+	return fseeko(f, (off_t)pos, SEEK_SET);
+#endif
+}
+
+static long long Tell(FILE *f)
+{
+#ifdef _WIN32
+	return _ftelli64(f);
+#else
+	return (long long)ftello(f);
+#endif
+}
+
+static size_t Pad8(size_t n)
+{
+	return (n + 7) & ~(size_t)7;
+}
+
+static bool Put(FILE *out, const void *data, size_t n)
+{
+	return n == 0 || fwrite(data, 1, n, out) == n;
+}
+
+static bool Padding(FILE *out, size_t n)
+{
+	static const char zeros[8] = {0};
+	return Put(out, zeros, Pad8(n) - n);
+}
+
+static bool Tag(FILE *out, uint32_t type, size_t bytes)
+{
+	uint32_t tag[2] = {type, (uint32_t)bytes};
+	return Put(out, tag, sizeof(tag));
+}
+
+// miMATRIX tag, array flags, dimensions and name; the caller writes the data element
+static bool MatrixHeader(FILE *out, uint32_t array_class, size_t rows, size_t cols,
+						 const string name, size_t data_bytes)
+{
+	size_t bytes = 16 + 16 + 8 + Pad8(name.size()) + 8 + Pad8(data_bytes);
+	uint32_t flags[2] = {array_class, 0};
+	int32_t dims[2] = {(int32_t)rows, (int32_t)cols};
+	return Tag(out, eMiMatrix, bytes)
+		&& Tag(out, eMiUInt32, sizeof(flags)) && Put(out, flags, sizeof(flags))
+		&& Tag(out, eMiInt32, sizeof(dims)) && Put(out, dims, sizeof(dims))
+		&& Tag(out, eMiInt8, name.size()) && Put(out, name.c_str(), name.size()) && Padding(out, name.size());
+}
+
+MatFileWriter::MatFileWriter(void)
+{
+	_failed = false;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+MatFileWriter::~MatFileWriter(void)
+{
+	Close();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool MatFileWriter::Open(const string file)
+{
+	Close();
+	if (file.empty()) return 0;
+	// fail now rather than at Close() if the file cannot be created
+	FILE *out = fopen(file.c_str(), "wb");
+	if (!out) return 0;
+	fclose(out);
+	remove(file.c_str());
+	_file = file;
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+int MatFileWriter::AddVariable(const string name, const string time_name, const vector<string>& columns)
+{
+	if (!IsOpen() || name.empty()) return -1;
+	Variable var;
+	var.name = name;
+	var.columns.push_back(time_name);
+	var.columns.insert(var.columns.end(), columns.begin(), columns.end());
+	var.part_name = _file + "." + name + ".part";
+	var.part = fopen(var.part_name.c_str(), "w+b");
+	var.rows = 0;
+	if (!var.part) return -1;
+	setvbuf(var.part, 0L, _IOFBF, 1 << 20);
+	_vars.push_back(var);
+	return (int)_vars.size() - 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void MatFileWriter::Append(int var, double time, const double *values)
+{
+	if (var < 0 || var >= (int)_vars.size()) return;
+	Variable& v = _vars[var];
+	const size_t n = v.columns.size() - 1;
+	if ((v.rows + 1)*(n + 1)*sizeof(double) > MaxBytes)
+	{
+		_failed = true;
+		return;
+	}
+	if (fwrite(&time, sizeof(double), 1, v.part) != 1 ||
+		(n > 0 && fwrite(values, sizeof(double), n, v.part) != n))
+	{
+		_failed = true;
+		return;
+	}
+	v.rows++;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool MatFileWriter::WriteMatrix(FILE *out, Variable& var)
+{
+	const size_t cols = var.columns.size(), rows = var.rows;
+	const size_t bytes = rows*cols*sizeof(double);
+	if (!MatrixHeader(out, eMxDouble, rows, cols, var.name, bytes) || !Tag(out, eMiDouble, bytes))
+		return 0;
+	const long long start = Tell(out);
+	if (start < 0 || Seek(var.part, 0) != 0) return 0;
+
+	// rows come in as read, each block's columns go to their place in the column-major data
+	const size_t block_rows = std::max<size_t>(1, (1 << 20)/cols);
+	vector<double> block(block_rows*cols), column(block_rows);
+	for (size_t first=0; first<rows; first+=block_rows)
+	{
+		const size_t n = std::min(block_rows, rows - first);
+		if (fread(&block[0], sizeof(double), n*cols, var.part) != n*cols)
+			return 0;
+		for (size_t c=0; c<cols; c++)
+		{
+			for (size_t i=0; i<n; i++)
+				column[i] = block[i*cols + c];
+			if (Seek(out, start + (long long)((c*rows + first)*sizeof(double))) != 0 ||
+				!Put(out, &column[0], n*sizeof(double)))
+				return 0;
+		}
+	}
+	// doubles need no padding
+	return Seek(out, start + (long long)bytes) == 0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool MatFileWriter::WriteNames(FILE *out, const Variable& var)
+{
+	// a char matrix, one blank padded name per row, as char({...}) gives
+	const size_t rows = var.columns.size();
+	size_t width = 0;
+	for (size_t i=0; i<rows; i++)
+		width = std::max(width, var.columns[i].size());
+	vector<uint16_t> chars(rows*width, ' ');
+	for (size_t i=0; i<rows; i++)
+		for (size_t j=0; j<var.columns[i].size(); j++)
+			chars[j*rows + i] = (unsigned char)var.columns[i][j];
+	const size_t bytes = chars.size()*sizeof(uint16_t);
+	return MatrixHeader(out, eMxChar, rows, width, var.name + "_names", bytes)
+		&& Tag(out, eMiUInt16, bytes) && Put(out, chars.empty() ? 0L : &chars[0], bytes)
+		&& Padding(out, bytes);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool MatFileWriter::Close(void)
+{
+	if (!IsOpen()) return 1;
+
+	FILE *out = fopen(_file.c_str(), "wb");
+	bool written = out != 0L;
+	if (written)
+	{
+		// 116 bytes of text, the subsystem data offset, the version and the endian indicator
+		char text[128], date[64];
+		time_t now = time(0L);
+		strftime(date, sizeof(date), "%a %b %d %H:%M:%S %Y", localtime(&now));
+		memset(text, ' ', sizeof(text));
+		int n = sprintf(text, "MATLAB 5.0 MAT-file, Platform: JSBSim, Created on: %s", date);
+		text[n] = ' ';
+		const char subsys[8] = {0};
+		uint16_t version = 0x0100, endian = ('M' << 8) | 'I';
+		written = Put(out, text, 116) && Put(out, subsys, sizeof(subsys))
+			&& Put(out, &version, sizeof(version)) && Put(out, &endian, sizeof(endian));
+		for (size_t i=0; i<_vars.size() && written; i++)
+			written = fflush(_vars[i].part) == 0 && WriteMatrix(out, _vars[i]) && WriteNames(out, _vars[i]);
+		if (fclose(out) != 0) written = 0;
+	}
+	bool ok = written && !_failed;
+	Discard();
+	return ok;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void MatFileWriter::Discard(void)
+{
+	for (size_t i=0; i<_vars.size(); i++)
+	{
+		fclose(_vars[i].part);
+		remove(_vars[i].part_name.c_str());
+	}
+	_vars.clear();
+	_file.clear();
+	_failed = false;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -0,0 +1,64 @@
+#ifndef MATFILEWRITER_HEADER_H
+#define MATFILEWRITER_HEADER_H
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stddef.h>
+
+using std::string;
+using std::vector;
+
+/// Streams rows of double matrices into a Level 5 MAT-file, no Matlab library needed
+/*
+	Every variable is a matrix of [time values...] rows, one row per
+	Append(). Matlab stores matrices column-major and a MAT-file element
+	carries its size in front of the data, so rows are appended to one
+	part file per variable next to the output (<file>.<name>.part) and
+	Close() writes the header, then every variable transposed block-wise
+	from its part file, followed by a <name>_names char matrix of the
+	column names, and removes the part files. Until Close() the MAT-file
+	does not exist; after a crash the part files hold the raw rows.
+	Level 5 elements carry 32 bit sizes, a variable is capped at 2 GB
+	(MaxBytes) and rows beyond that are dropped, Close() then returns false.
+*/
+class MatFileWriter
+{
+public:
+	enum {MaxBytes = 0x7FF00000};
+
+	MatFileWriter(void);
+	~MatFileWriter(void);
+
+	bool Open(const string file);
+	/// Write the MAT-file and remove the part files, false on an I/O error or a capped variable
+	bool Close(void);
+	bool IsOpen(){return !_file.empty();}
+	const string& GetFileName(){return _file;}
+
+	/// A variable (a valid Matlab name) of time_name and the columns; -1 on failure
+	int AddVariable(const string name, const string time_name, const vector<string>& columns);
+	/// One row [time values...], values holding the columns of AddVariable
+	void Append(int var, double time, const double *values);
+	size_t GetRows(int var){return _vars[var].rows;}
+	size_t GetNumVariables(){return _vars.size();}
+
+private:
+	struct Variable
+	{
+		string name;
+		vector<string> columns;		// including the time column
+		string part_name;
+		FILE *part;
+		size_t rows;
+	};
+	bool WriteMatrix(FILE *out, Variable& var);
+	bool WriteNames(FILE *out, const Variable& var);
+	void Discard(void);
+
+	string _file;
+	vector<Variable> _vars;
+	bool _failed;
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
@@ -16,6 +16,9 @@
 #include <models/FGFCS.h>
 
 #include "JSBSimInterface.h"
+#include "JSBSimServer.h"
+#include "EnsembleRunner.h"
+#include "RolloutPool.h"
 
 using namespace std;
 
@@ -29,25 +32,159 @@ double dist2=0;
 double *data1;
 TCHAR szDummy[_MAX_PATH];
 
-// this object should be persistent in memory until
-// the MEX-function is cleared by Matlab
-JSBSim::FGFDMExec FDMExec;
-JSBSimInterface JI(&FDMExec);
+// One loaded aircraft: its FDMExec, the interface, the 'serve' thread and the
+// 'rollout' pool, made on first use.
+// Instances stay in memory until closed or the MEX-function is cleared by Matlab.
+struct MexInstance
+{
+	JSBSim::FGFDMExec *exec;
+	JSBSimInterface *ji;
+	JSBSimServer *server;
+	RolloutPool *rollout;
+};
+
+// slot table, handle h lives in slot h-1; a closed slot is NULL and reused
+#define MAX_INSTANCES 64
+vector<MexInstance *> Instances;
+
+MexInstance *NewInstance(int& handle)
+{
+	unsigned slot;
+	for (slot=0; slot<Instances.size(); slot++)
+		if (Instances[slot] == NULL) break;
+	if (slot >= MAX_INSTANCES) return NULL;
+	if (slot == Instances.size()) Instances.push_back(NULL);
+
+	MexInstance *inst = new MexInstance;
+	inst->exec = new JSBSim::FGFDMExec();
+	inst->ji = new JSBSimInterface(inst->exec, 1.0/120.0);
+	inst->server = new JSBSimServer(inst->ji);
+	inst->rollout = NULL;
+	Instances[slot] = inst;
+	handle = slot + 1;
+	return inst;
+}
+
+MexInstance *GetInstance(int handle)
+{
+	if (handle < 1 || handle > (int)Instances.size()) return NULL;
+	return Instances[handle-1];
+}
+
+void CloseInstance(int handle)
+{
+	MexInstance *inst = GetInstance(handle);
+	if (inst == NULL) return;
+	delete inst->server; // joins the sim thread first
+	delete inst->rollout;
+	delete inst->ji;
+	delete inst->exec;
+	delete inst;
+	Instances[handle-1] = NULL;
+}
+
+// one element of a statistics struct array
+const char *StatFields[] = {"name", "count", "mean", "std", "min", "t_min", "max", "t_max",
+	"p", "quantiles", "exceedances", "exceedance_events", "exceedance_time", "nan_count"};
+#define NUM_STAT_FIELDS (sizeof(StatFields)/sizeof(StatFields[0]))
+
+void SetStatFields(mxArray *s, mwIndex i, const string& name, const SignalStats& st)
+{
+	mxArray *p = mxCreateDoubleMatrix(1, st.GetNumQuantiles(), mxREAL);
+	mxArray *q = mxCreateDoubleMatrix(1, st.GetNumQuantiles(), mxREAL);
+	for (int k=0; k<st.GetNumQuantiles(); k++)
+	{
+		mxGetPr(p)[k] = st.GetQuantileP(k);
+		mxGetPr(q)[k] = st.GetQuantile(k);
+	}
+	mxSetField(s, i, "name", mxCreateString(name.c_str()));
+	mxSetField(s, i, "count", mxCreateDoubleScalar((double) st.GetCount()));
+	mxSetField(s, i, "mean", mxCreateDoubleScalar(st.GetMean()));
+	mxSetField(s, i, "std", mxCreateDoubleScalar(st.GetStd()));
+	mxSetField(s, i, "min", mxCreateDoubleScalar(st.GetMin()));
+	mxSetField(s, i, "t_min", mxCreateDoubleScalar(st.GetMinTime()));
+	mxSetField(s, i, "max", mxCreateDoubleScalar(st.GetMax()));
+	mxSetField(s, i, "t_max", mxCreateDoubleScalar(st.GetMaxTime()));
+	mxSetField(s, i, "p", p);
+	mxSetField(s, i, "quantiles", q);
+	mxSetField(s, i, "exceedances", mxCreateDoubleScalar((double) st.GetExceedances()));
+	mxSetField(s, i, "exceedance_events", mxCreateDoubleScalar((double) st.GetExceedanceEvents()));
+	mxSetField(s, i, "exceedance_time", mxCreateDoubleScalar(st.GetExceedanceTime()));
+	mxSetField(s, i, "nan_count", mxCreateDoubleScalar((double) st.GetNaNCount()));
+}
+
+// free all instances before Matlab unloads the MEX-file
+void exitFcn() {
+	for (unsigned i=0; i<Instances.size(); i++)
+		CloseInstance(i+1);
+	Instances.clear();
+}
 
 void helpOptions() {
 	mexPrintf("function usage:\n"                                           );
-	mexPrintf("result = MexJSBSim( string_directive [, string, value] )\n"  );
+	mexPrintf("result = MexJSBSim( string_directive [, handle] [, string, value] )\n");
+	mexPrintf("\n"                                                          );
+	mexPrintf("Every directive but 'help' and 'open' takes the handle returned by 'open'.\n");
+	mexPrintf("Without a handle it applies to handle 1, the first aircraft opened.\n");
 	mexPrintf("\n"                                                          );
 	mexPrintf("Examples:\n"                                                 );
 	mexPrintf("    res = MexJSBSim('help');\n"                              );
 	mexPrintf("			returns 1 (always)\n"                               );
-	mexPrintf("    res = MexJSBSim('open','c172r');\n"                      );
-	mexPrintf("			returns 1 if success, 0 otherwise\n"                );
-	mexPrintf("    res = MexJSBSim('get','fcs/elevator-cmd-norm')\n"        );
+	mexPrintf("    h = MexJSBSim('open','c172r');\n"                        );
+	mexPrintf("			returns a handle > 0 if success, 0 otherwise\n"     );
+	mexPrintf("    res = MexJSBSim('close',h);\n"                           );
+	mexPrintf("			frees the aircraft, returns 1 if h was open\n"      );
+	mexPrintf("    res = MexJSBSim('get',h,'fcs/elevator-cmd-norm')\n"      );
 	mexPrintf("			returns the value of the property,\n"               );
 	mexPrintf("			or the string 'Property not found'\n"               );
-	mexPrintf("    res = MexJSBSim('set','fcs/elevator-cmd-norm',-0.5)\n"   );
+	mexPrintf("    res = MexJSBSim('set',h,'fcs/elevator-cmd-norm',-0.5)\n" );
 	mexPrintf("			returns 1 if success, 0 otherwise\n"                );
+	mexPrintf("    res = MexJSBSim('set',h,'integrator/rate/rotational',4)\n");
+	mexPrintf("			selects the integrator (0-5, see JSBSimInterface.h)\n");
+	mexPrintf("    res = MexJSBSim('init',h,ic)\n"                          );
+	mexPrintf("			ic is a name/value structure array\n"               );
+	mexPrintf("    res = MexJSBSim('init',[h,]{'u-fps','h-sl-ft',...},[80 1000 ...])\n");
+	mexPrintf("			numeric init, the names are resolved once to setters\n");
+	mexPrintf("    res = MexJSBSim('init',[h1 h2 ...],{'u-fps',...},[80 ...; 90 ...; ...])\n");
+	mexPrintf("			batch init, row k initializes handle k; returns one flag per handle\n");
+	mexPrintf("    res = MexJSBSim('catalog',h)\n"                          );
+	mexPrintf("    res = MexJSBSim('serve',h,120 [,{'velocities/vc-kts',...}])\n");
+	mexPrintf("			runs the aircraft at 120 frames/s on a background thread,\n");
+	mexPrintf("			optionally publishing the listed properties instead of the 12 states\n");
+	mexPrintf("    res = MexJSBSim('command',h,'fcs/elevator-cmd-norm',-0.5)\n");
+	mexPrintf("			queues a property command for the next served frame\n");
+	mexPrintf("    res = MexJSBSim('state',h)\n"                            );
+	mexPrintf("			returns the latest served frame [sim-time values...]\n");
+	mexPrintf("    res = MexJSBSim('stop',h)\n"                             );
+	mexPrintf("			stops serving, returns the number of frames run\n");
+	mexPrintf("    res = MexJSBSim('record',h,{'position/h-sl-ft','gear/gear-pos-norm',...} [,every])\n");
+	mexPrintf("			keeps a compressed in-memory history of the properties, every n-th step\n");
+	mexPrintf("    [res,bytes] = MexJSBSim('history',h)\n");
+	mexPrintf("			decodes the history to one row [sim-time recorded...] per kept step;\n");
+	mexPrintf("			bytes is [compressed uncompressed]\n");
+	mexPrintf("    res = MexJSBSim('stop-when',h,{'position/h-agl-ft < 10','nan',...})\n");
+	mexPrintf("			sets the conditions that end a served run, returns their reason codes;\n");
+	mexPrintf("			{} clears them. Ops are > >= < <= == !=, 'nan' checks the states\n");
+	mexPrintf("    [res,util,stats] = MexJSBSim('ensemble','c172r',{'u-fps',...},ic,durations,threads [,chunk_s [,{'position/h-sl-ft',...} [,stops [,stat_specs]]]])\n");
+	mexPrintf("			runs row k of ic for durations(k) s on a pool of threads, each case on\n");
+	mexPrintf("			its own aircraft and ended early by the 'stop-when' style conditions stops;\n");
+	mexPrintf("			res has one row [ok sim-time worker stop-reason watched...] per case,\n");
+	mexPrintf("			util one row [utilization busy-s runs chunks steals] per worker;\n");
+	mexPrintf("			stat_specs such as {'accelerations/Nz q 0.5 0.99 > 3.8'} are kept over each\n");
+	mexPrintf("			run instead of its history, stats(k,j) summarizes spec j of case k\n");
+	mexPrintf("    res = MexJSBSim('save-checkpoint',h,'toc.ckpt')\n");
+	mexPrintf("    res = MexJSBSim('load-checkpoint',h,'toc.ckpt')\n");
+	mexPrintf("			saves the simulation state to a file, or warm-starts from one saved\n");
+	mexPrintf("			for the same aircraft and dt; see JSBSimInterface::TakeSnapshot for its limits\n");
+	mexPrintf("    [cost,traj] = MexJSBSim('rollout',h,U [,workers [,{'position/h-sl-ft',...} [,weights [,refs [,input_weights]]]]])\n");
+	mexPrintf("			steps the K candidate input sequences of U (inputs x N steps x K) from the\n");
+	mexPrintf("			current state on a pool of pre-loaded copies of the aircraft (workers 0 =\n");
+	mexPrintf("			one per core, the 12 states watched by default); traj is watched x N x K,\n");
+	mexPrintf("			cost(k) sums weights.*(watched-refs).^2 + input_weights.*u.^2 over the steps\n");
+	mexPrintf("    [res,report] = MexJSBSim('replay','run42.jrn')\n");
+	mexPrintf("			re-runs a journal recorded with the S-function's 'sfun/journal' option on a\n");
+	mexPrintf("			fresh aircraft at full speed, returns 1 if every state checkpoint matched;\n");
+	mexPrintf("			report is [frames checkpoints last-good-frame diverged-frame (-1 none) wall-s]\n");
 }
 
 // the gataway function
@@ -57,106 +194,529 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 	string aircraftName = "";
 	string option = "";
 
-	/*
-	if (myobj==NULL) // this is the first call to MEX-function
-	{ 
-		mexPrintf("First call to MEX-file\n");
-		myobj = (void *)FDMExec;
-		mexMakeMemoryPersistent(myobj);
-		// register a mexAtExit function to free allocated memory 
-		// in the event this MEX-file is cleared
-		mexAtExit(exitFcn);
+	mexAtExit(exitFcn);
+
+	if (nrhs==0)
+	{
+		helpOptions();
+		return;
 	}
-	*/
 
-	if (nrhs>0)
+	char buf[128];
+	mwSize buflen;
+	buflen = mxGetNumberOfElements(prhs[0]) + 1;
+	mxGetString(prhs[0], buf, sizeof(buf) < buflen ? sizeof(buf) : buflen);
+	option = string(buf);
+
+	plhs[0] = mxCreateDoubleMatrix(1, 1, mxREAL);
+
+	if ( option == "help" )
 	{
-		char buf[128];
-		mwSize buflen;
-		buflen = mxGetNumberOfElements(prhs[0]) + 1;
-		mxGetString(prhs[0], buf, buflen);
+		helpOptions();
+		*mxGetPr(plhs[0]) = 1;
+		return;
+	}
 
-		plhs[0] = mxCreateDoubleMatrix(1, 1, mxREAL);
+	if ( option == "open" )
+	{
+		if (nrhs<2 || !mxIsChar(prhs[1]))
+		{
+			mexPrintf("ERROR: uncorrect use of 'open' option.\n");
+			return;
+		}
+		char ac_buf[128];
+		mxGetString(prhs[1], ac_buf, sizeof(ac_buf));
+		int handle;
+		MexInstance *inst = NewInstance(handle);
+		if ( inst == NULL )
+			mexPrintf("Too many aircraft open, close one first.\n");
+		else if ( !inst->ji->Open(string(ac_buf)) ) // load a/c in JSBSim
+		{
+			mexPrintf("JSBSim could not be started.\n");
+			CloseInstance(handle);
+		}
+		else
+			*mxGetPr(plhs[0]) = handle;
+		return;
+	}
 
-		if (nrhs==1)
+	// numeric init of one or many instances: 'init' [, handles], names, values (one row per handle);
+	// without handles it initializes handle 1, like the other directives
+	const bool init_handles = option == "init" && nrhs>3 && mxIsDouble(prhs[1]) && mxIsCell(prhs[2]) && mxIsDouble(prhs[3]);
+	if ( init_handles || (option == "init" && nrhs==3 && mxIsCell(prhs[1]) && mxIsDouble(prhs[2])) )
+	{
+		const int a = init_handles ? 2 : 1;	// names at prhs[a], values at prhs[a+1]
+		const double default_handle = 1;
+		const double *handles = init_handles ? mxGetPr(prhs[1]) : &default_handle;
+		mwSize num_handles = init_handles ? mxGetNumberOfElements(prhs[1]) : 1;
+		mwSize num_names = mxGetNumberOfElements(prhs[a]);
+		if ( mxGetN(prhs[a+1]) != num_names || mxGetM(prhs[a+1]) != num_handles )
+		{
+			mexPrintf("ERROR: 'init' values must have one row per handle and one column per name.\n");
+			return;
+		}
+		vector<string> names;
+		for (mwIndex j=0; j<num_names; j++)
+		{
+			char n_buf[128];
+			mxGetString(mxGetCell(prhs[a],j), n_buf, sizeof(n_buf));
+			names.push_back(string(n_buf));
+		}
+		mxDestroyArray(plhs[0]);
+		plhs[0] = mxCreateDoubleMatrix(1, num_handles, mxREAL);
+		const double *values = mxGetPr(prhs[a+1]);
+		vector<double> row(num_names);
+		for (mwIndex k=0; k<num_handles; k++)
 		{
-			option = string(buf);
+			MexInstance *inst = GetInstance((int) handles[k]);
+			if ( inst == NULL || inst->server->IsRunning() )
+			{
+				mexPrintf("No idle aircraft open with handle %d.\n", (int) handles[k]);
+				continue;
+			}
+			// Matlab matrices are column major, gather row k
+			for (mwIndex j=0; j<num_names; j++)
+				row[j] = values[k + j*num_handles];
+			JIInitList list;
+			inst->ji->ResolveInitList(names, list);
+			mxGetPr(plhs[0])[k] = inst->ji->Init(list, num_names ? &row[0] : NULL);
+		}
+		return;
+	}
 
-			if ( option == "help")
+	// independent runs on private instances: 'ensemble', aircraft, names, ic, durations, threads [, chunk_s [, watch [, stops [, stats]]]]
+	if ( option == "ensemble" )
+	{
+		if ( nrhs<6 || !mxIsChar(prhs[1]) || !mxIsCell(prhs[2]) || !mxIsDouble(prhs[3])
+			|| !mxIsDouble(prhs[4]) || !mxIsNumeric(prhs[5]) || (nrhs>7 && !mxIsCell(prhs[7]))
+			|| (nrhs>8 && !mxIsCell(prhs[8])) || (nrhs>9 && !mxIsCell(prhs[9])) )
+		{
+			mexPrintf("ERROR: uncorrect use of 'ensemble' option.\n");
+			return;
+		}
+		char ac_buf[128];
+		mxGetString(prhs[1], ac_buf, sizeof(ac_buf));
+		vector<string> names, watch, stops, stat_specs;
+		for (mwIndex j=0; j<mxGetNumberOfElements(prhs[2]); j++)
+		{
+			char n_buf[128];
+			mxGetString(mxGetCell(prhs[2],j), n_buf, sizeof(n_buf));
+			names.push_back(string(n_buf));
+		}
+		if ( nrhs>7 )
+			for (mwIndex j=0; j<mxGetNumberOfElements(prhs[7]); j++)
 			{
-				helpOptions();
-				*mxGetPr(plhs[0]) = 1;
+				char n_buf[128];
+				mxGetString(mxGetCell(prhs[7],j), n_buf, sizeof(n_buf));
+				watch.push_back(string(n_buf));
 			}
-			else
+		if ( nrhs>8 )
+			for (mwIndex j=0; j<mxGetNumberOfElements(prhs[8]); j++)
+			{
+				char n_buf[128];
+				mxGetString(mxGetCell(prhs[8],j), n_buf, sizeof(n_buf));
+				stops.push_back(string(n_buf));
+			}
+		if ( nrhs>9 )
+			for (mwIndex j=0; j<mxGetNumberOfElements(prhs[9]); j++)
 			{
-				if ( option == "catalog")
-				{
-					JI.PrintCatalog();
-					*mxGetPr(plhs[0]) = 1;
-				}
-				else
-				{
-					mexPrintf("Uncorrect call to this function.\n\n");
-					helpOptions();
-					*mxGetPr(plhs[0]) = 0;
-				}
+				char n_buf[256];
+				mxGetString(mxGetCell(prhs[9],j), n_buf, sizeof(n_buf));
+				stat_specs.push_back(string(n_buf));
 			}
+
+		// one row of ic per case, a scalar duration applies to all of them
+		mwSize num_cases = mxGetM(prhs[3]);
+		mwSize num_durations = mxGetNumberOfElements(prhs[4]);
+		if ( mxGetN(prhs[3]) != names.size() || (num_durations != 1 && num_durations != num_cases) )
+		{
+			mexPrintf("ERROR: 'ensemble' ic must have one column per name, durations one entry per row.\n");
+			return;
 		}
-		if (nrhs>1)
+		const double *ic = mxGetPr(prhs[3]);
+		const double *durations = mxGetPr(prhs[4]);
+		vector<EnsembleCase> cases(num_cases);
+		for (mwIndex k=0; k<num_cases; k++)
 		{
-			option = string(buf);
-
-			if ( option == "open" )
+			cases[k].duration = durations[num_durations == 1 ? 0 : k];
+			for (mwIndex j=0; j<names.size(); j++)
+				cases[k].ic_values.push_back(ic[k + j*num_cases]);
+		}
+		int threads = (int) mxGetScalar(prhs[5]);
+		double chunk = nrhs>6 ? mxGetScalar(prhs[6]) : 1.0;
+
+		EnsembleRunner runner(string(ac_buf), 1.0/120.0, names, watch);
+		runner.SetStopConditions(stops);
+		runner.SetStatistics(stat_specs);
+		runner.Run(cases, threads, chunk);
+
+		const vector<EnsembleResult>& results = runner.GetResults();
+		mxDestroyArray(plhs[0]);
+		plhs[0] = mxCreateDoubleMatrix(num_cases, 4 + watch.size(), mxREAL);
+		double *res = mxGetPr(plhs[0]);
+		for (mwIndex k=0; k<num_cases; k++)
+		{
+			res[k] = results[k].ok;
+			res[k + num_cases] = results[k].sim_time;
+			res[k + 2*num_cases] = results[k].worker + 1;
+			res[k + 3*num_cases] = results[k].stop_reason;
+			for (mwIndex j=0; j<watch.size(); j++)
+				res[k + (4+j)*num_cases] = results[k].watch[j];
+		}
+		if ( nlhs>1 )
+		{
+			const vector<EnsembleWorkerStats>& stats = runner.GetWorkerStats();
+			mwSize n = stats.size();
+			plhs[1] = mxCreateDoubleMatrix(n, 5, mxREAL);
+			double *util = mxGetPr(plhs[1]);
+			for (mwIndex w=0; w<n; w++)
 			{
-				if ( !JI.Open(prhs[1]) ) // load a/c in JSBSim
-					mexPrintf("JSBSim could not be started.\n");
-				else
-					*mxGetPr(plhs[0]) = 1;
+				util[w] = stats[w].Utilization();
+				util[w + n] = stats[w].busy;
+				util[w + 2*n] = stats[w].runs;
+				util[w + 3*n] = stats[w].chunks;
+				util[w + 4*n] = stats[w].steals;
+			}
+		}
+		if ( nlhs>2 )
+		{
+			// a case that failed to load keeps empty summaries
+			plhs[2] = mxCreateStructMatrix(num_cases, stat_specs.size(), NUM_STAT_FIELDS, StatFields);
+			for (mwIndex k=0; k<num_cases; k++)
+				for (mwIndex j=0; j<results[k].stats.size(); j++)
+					SetStatFields(plhs[2], k + j*num_cases, stat_specs[j], results[k].stats[j]);
+		}
+		return;
+	}
+
+	// re-run a journal written with the S-function's 'sfun/journal' option: 'replay', file
+	if ( option == "replay" )
+	{
+		if ( nrhs<2 || !mxIsChar(prhs[1]) )
+		{
+			mexPrintf("ERROR: uncorrect use of 'replay' option.\n");
+			return;
+		}
+		char f_buf[256];
+		mxGetString(prhs[1], f_buf, sizeof(f_buf));
+		JIReplayReport report;
+		*mxGetPr(plhs[0]) = JSBSimInterface::ReplayJournal(string(f_buf), report);
+		if ( !report.loaded )
+			mexPrintf("Journal '%s' could not be replayed: %s.\n", f_buf, report.error.c_str());
+		else
+		{
+			mexPrintf("Replayed %lu frames (%.1f s sim-time) in %.2f s, %lu checkpoints matched.\n",
+				(unsigned long) report.steps, report.sim_time, report.wall_time, (unsigned long) report.checkpoints);
+			if ( report.diverged_step >= 0 )
+				mexPrintf("The states diverged between frame %ld and frame %ld.\n",
+					(long) report.last_good_step, (long) report.diverged_step);
+			if ( report.aircraft_changed )
+				mexPrintf("The aircraft file is not the one the journal was recorded with.\n");
+		}
+		if ( nlhs>1 )
+		{
+			plhs[1] = mxCreateDoubleMatrix(1, 5, mxREAL);
+			double *r = mxGetPr(plhs[1]);
+			r[0] = (double) report.steps;
+			r[1] = (double) report.checkpoints;
+			r[2] = (double) report.last_good_step;
+			r[3] = (double) report.diverged_step;
+			r[4] = report.wall_time;
+		}
+		return;
+	}
+
+	// the handle is the first argument after the directive; 'serve' always has a
+	// numeric rate there, so its handle form is told apart by the argument count
+	int handle = 1;
+	int arg = 1;
+	if ( option == "serve" ? (nrhs>2 && mxIsNumeric(prhs[2])) : (nrhs>1 && mxIsNumeric(prhs[1])) )
+	{
+		handle = (int) mxGetScalar(prhs[1]);
+		arg = 2;
+	}
+	MexInstance *inst = GetInstance(handle);
+	if ( inst == NULL )
+	{
+		mexPrintf("No aircraft open with handle %d.\n", handle);
+		return;
+	}
+	JSBSimInterface& JI = *inst->ji;
+	JSBSimServer& Server = *inst->server;
+	int nargs = nrhs - arg; // arguments after the handle
 
+	if ( option == "close" )
+	{
+		CloseInstance(handle);
+		*mxGetPr(plhs[0]) = 1;
+		return;
+	}
+
+	// while serving the sim thread owns JI, only 'command', 'state' and 'stop' may reach it
+	if ( Server.IsRunning() && option != "command" && option != "state" && option != "stop" )
+	{
+		mexPrintf("JSBSim is serving, use 'command' and 'state', or 'stop' first.\n");
+		*mxGetPr(plhs[0]) = 0;
+		return;
+	}
+
+	if ( option == "catalog" )
+	{
+		JI.PrintCatalog();
+		*mxGetPr(plhs[0]) = 1;
+	}
+	else if ( option == "state" )
+	{
+		// never waits for the sim thread, just copies the last complete frame
+		vector<double> values;
+		if ( !Server.Snapshot(values) )
+		{
+			mexPrintf("No served frame available.\n");
+			*mxGetPr(plhs[0]) = 0;
+		}
+		else
+		{
+			mxDestroyArray(plhs[0]);
+			plhs[0] = mxCreateDoubleMatrix(1, values.size(), mxREAL);
+			for (unsigned i=0; i<values.size(); i++)
+				mxGetPr(plhs[0])[i] = values[i];
+		}
+	}
+	else if ( option == "stop" )
+	{
+		Server.Stop();
+		RealTimePacer& pacer = Server.GetPacer();
+		mexPrintf("Served %ld frames, %ld deadline misses, max jitter %.1f us.\n",
+			pacer.GetFrames(), pacer.GetMisses(), pacer.GetMaxJitter()*1.0e6);
+		if ( JI.IsStopped() )
+			mexPrintf("Stopped at sim-time %f s by condition %d: %s\n", JI.GetStopTime(),
+				JI.GetStopReason(), JI.GetStopCondition(JI.GetStopReason()).c_str());
+		*mxGetPr(plhs[0]) = (double) pacer.GetFrames();
+	}
+	else if ( option == "get" && nargs>0 )
+	{
+		// TO DO: if ( !JI.Get(prhs[arg]) )
+		double value;
+		if ( !JI.GetPropertyValue(prhs[arg],value) )
+		{
+			mexPrintf("Check property name.\n");
+			*mxGetPr(plhs[0]) = 0;
+			return;
+		}
+		else
+			*mxGetPr(plhs[0]) = value;
+	}
+	else if ( option == "set" )
+	{
+		if (nargs>1)
+		{
+			if ( !JI.SetPropertyValue(prhs[arg],prhs[arg+1]) )
+			{
+				mexPrintf("Property could not be set.\n");
+				*mxGetPr(plhs[0]) = 0;
 			}
-			if ( option == "get" )
+			else
+				*mxGetPr(plhs[0]) = 1;
+		}
+		else
+			mexPrintf("ERROR: uncorrect use of 'set' option.\n");
+	}
+	else if ( option == "init" && nargs>0 )
+	{
+		if ( !mxIsStruct(prhs[arg]) )
+		{
+			mexPrintf("ERROR: uncorrect use of 'init' option.\n");
+			*mxGetPr(plhs[0]) = 0;
+		}
+		else if ( !JI.Init(prhs[arg]) )
+		{
+			mexPrintf("Initialization failed.\n");
+			*mxGetPr(plhs[0]) = 0;
+		}
+		else
+			*mxGetPr(plhs[0]) = 1;
+	}
+	else if ( option == "serve" && nargs>0 )
+	{
+		vector<string> watch; // the 12 states by default
+		JSBSimInterface::GetOutputNames(JISignalMap(), JSBSimInterface::eStatePort, watch);
+		if ( nargs>1 && mxIsCell(prhs[arg+1]) )
+		{
+			watch.clear();
+			for (mwIndex i=0; i<mxGetNumberOfElements(prhs[arg+1]); i++)
+			{
+				char w_buf[256];
+				mxGetString(mxGetCell(prhs[arg+1],i), w_buf, sizeof(w_buf));
+				watch.push_back(string(w_buf));
+			}
+		}
+		if ( !Server.Start(mxGetScalar(prhs[arg]), watch) )
+			mexPrintf("JSBSim could not be served, load an aircraft and give a rate > 0.\n");
+		else
+			*mxGetPr(plhs[0]) = 1;
+	}
+	else if ( option == "record" && nargs>0 && mxIsCell(prhs[arg]) )
+	{
+		vector<string> names;
+		for (mwIndex i=0; i<mxGetNumberOfElements(prhs[arg]); i++)
+		{
+			char r_buf[256];
+			mxGetString(mxGetCell(prhs[arg],i), r_buf, sizeof(r_buf));
+			names.push_back(string(r_buf));
+		}
+		int every = nargs>1 ? (int) mxGetScalar(prhs[arg+1]) : 1;
+		if ( !JI.SetRecordList(names, every) )
+			mexPrintf("Check property names.\n");
+		else
+			*mxGetPr(plhs[0]) = 1;
+	}
+	else if ( option == "history" )
+	{
+		HistoryBuffer& history = JI.GetHistory();
+		mwSize n = history.GetLength();
+		int width = history.GetNumSignals();
+		mxDestroyArray(plhs[0]);
+		plhs[0] = mxCreateDoubleMatrix(n, width + 1, mxREAL);
+		// Matlab matrices are column major, each series decodes straight into its column
+		if ( n > 0 )
+		{
+			history.DecodeTime(mxGetPr(plhs[0]));
+			for (int i=0; i<width; i++)
+				history.DecodeSignal(i, mxGetPr(plhs[0]) + (i+1)*n);
+		}
+		if ( nlhs>1 )
+		{
+			plhs[1] = mxCreateDoubleMatrix(1, 2, mxREAL);
+			mxGetPr(plhs[1])[0] = (double) history.GetBytes();
+			mxGetPr(plhs[1])[1] = (double) history.GetRawBytes();
+		}
+	}
+	else if ( option == "stop-when" && nargs>0 && mxIsCell(prhs[arg]) )
+	{
+		JI.ClearStopConditions();
+		mwSize n = mxGetNumberOfElements(prhs[arg]);
+		mxDestroyArray(plhs[0]);
+		plhs[0] = mxCreateDoubleMatrix(1, n, mxREAL);
+		for (mwIndex i=0; i<n; i++)
+		{
+			char s_buf[256];
+			mxGetString(mxGetCell(prhs[arg],i), s_buf, sizeof(s_buf));
+			int reason = JI.AddStopCondition(string(s_buf));
+			if ( !reason )
+				mexPrintf("Stop condition '%s' is not valid for this aircraft.\n", s_buf);
+			mxGetPr(plhs[0])[i] = reason;
+		}
+	}
+	else if ( (option == "save-checkpoint" || option == "load-checkpoint") && nargs>0 && mxIsChar(prhs[arg]) )
+	{
+		char f_buf[256];
+		mxGetString(prhs[arg], f_buf, sizeof(f_buf));
+		bool saved = option == "save-checkpoint";
+		if ( saved ? !JI.SaveCheckpoint(string(f_buf)) : !JI.LoadCheckpoint(string(f_buf)) )
+		{
+			mexPrintf("Checkpoint '%s' could not be %s.\n", f_buf, saved ? "saved" : "loaded");
+			*mxGetPr(plhs[0]) = 0;
+		}
+		else
+			*mxGetPr(plhs[0]) = 1;
+	}
+	else if ( option == "rollout" && nargs>0 && mxIsDouble(prhs[arg]) )
+	{
+		const mwSize *dims = mxGetDimensions(prhs[arg]);
+		mwSize num_dims = mxGetNumberOfDimensions(prhs[arg]);
+		int N = (int) dims[1];
+		int K = num_dims > 2 ? (int) dims[2] : 1;
+		int workers = nargs>1 ? (int) mxGetScalar(prhs[arg+1]) : 0;
+		vector<string> watch;
+		if ( nargs>2 && mxIsCell(prhs[arg+2]) )
+			for (mwIndex j=0; j<mxGetNumberOfElements(prhs[arg+2]); j++)
 			{
-				
-				// TO DO: if ( !JI.Get(prhs[1]) )
-				double value;
-				if ( !JI.GetPropertyValue(prhs[1],value) )
-				{
-					mexPrintf("Check property name.\n");
-					*mxGetPr(plhs[0]) = 0;
-					return;
-				}
-				else
-					*mxGetPr(plhs[0]) = value;
+				char n_buf[128];
+				mxGetString(mxGetCell(prhs[arg+2],j), n_buf, sizeof(n_buf));
+				watch.push_back(string(n_buf));
 			}
-			if ( option == "set" )
+		if ( (nargs>3 && !mxIsDouble(prhs[arg+3])) || (nargs>4 && !mxIsDouble(prhs[arg+4]))
+			|| (nargs>5 && !mxIsDouble(prhs[arg+5])) )
+		{
+			mexPrintf("ERROR: 'rollout' weights, refs and input_weights must be double arrays.\n");
+			*mxGetPr(plhs[0]) = 0;
+			return;
+		}
+		vector<double> weights, refs, input_weights;
+		if ( nargs>3 ) weights.assign(mxGetPr(prhs[arg+3]), mxGetPr(prhs[arg+3]) + mxGetNumberOfElements(prhs[arg+3]));
+		if ( nargs>4 ) refs.assign(mxGetPr(prhs[arg+4]), mxGetPr(prhs[arg+4]) + mxGetNumberOfElements(prhs[arg+4]));
+		if ( nargs>5 ) input_weights.assign(mxGetPr(prhs[arg+5]), mxGetPr(prhs[arg+5]) + mxGetNumberOfElements(prhs[arg+5]));
+
+		// the live instance must hold still while the pool reads it
+		if ( Server.IsRunning() )
+		{
+			mexPrintf("ERROR: 'rollout' needs the aircraft stopped, call 'stop' first.\n");
+			*mxGetPr(plhs[0]) = 0;
+			return;
+		}
+		// the pool is loaded once and kept while the worker count stays the same
+		if ( inst->rollout == NULL )
+			inst->rollout = new RolloutPool();
+		RolloutPool& pool = *inst->rollout;
+		if ( !pool.IsOpen() || (workers > 0 && workers != pool.GetNumWorkers()) )
+		{
+			if ( !watch.empty() ) pool.SetWatch(watch);
+			if ( !pool.Open(JI, workers) )
 			{
-				if (nrhs>2)
-				{
-					if ( !JI.SetPropertyValue(prhs[1],prhs[2]) )
-					{
-						mexPrintf("Property could not be set.\n");
-						*mxGetPr(plhs[0]) = 0;
-					}
-					else
-						*mxGetPr(plhs[0]) = 1;
-				}
-				else
-					mexPrintf("ERROR: uncorrect use of 'set' option.\n");
+				mexPrintf("The rollout pool could not be loaded.\n");
+				*mxGetPr(plhs[0]) = 0;
+				return;
 			}
-			if ( option == "init" )
+		}
+		if ( !watch.empty() && watch != pool.GetWatch() && !pool.SetWatch(watch) )
+		{
+			mexPrintf("Check watched property names.\n");
+			*mxGetPr(plhs[0]) = 0;
+			return;
+		}
+		if ( (int) mxGetM(prhs[arg]) != pool.GetInputWidth() || N < 1 || K < 1 )
+		{
+			mexPrintf("ERROR: 'rollout' U must have %d rows, one per input.\n", pool.GetInputWidth());
+			*mxGetPr(plhs[0]) = 0;
+			return;
+		}
+		pool.SetCost(weights, refs, input_weights);
+
+		mwSize traj_dims[3] = {pool.GetWatch().size(), (mwSize) N, (mwSize) K};
+		mxArray *traj = mxCreateNumericArray(3, traj_dims, mxDOUBLE_CLASS, mxREAL);
+		mxDestroyArray(plhs[0]);
+		plhs[0] = mxCreateDoubleMatrix(1, K, mxREAL);
+		pool.Rollout(JI, K, N, mxGetPr(prhs[arg]), mxGetPr(traj), mxGetPr(plhs[0]));
+		if ( JI.verbosityLevel == JSBSimInterface::eVerbose )
+			mexPrintf("\t%d candidates of %d steps rolled out on %d workers in %g s\n", K, N, pool.GetNumWorkers(), pool.GetLastTime());
+		if ( nlhs>1 )
+			plhs[1] = traj;
+		else
+			mxDestroyArray(traj);
+	}
+	else if ( option == "command" )
+	{
+		if (nargs>1)
+		{
+			char c_buf[256];
+			mxGetString(prhs[arg], c_buf, sizeof(c_buf));
+			if ( !Server.IsRunning() || !Server.Command(string(c_buf), mxGetScalar(prhs[arg+1])) )
 			{
-					if ( !JI.Init(prhs[1]) )
-					{
-						mexPrintf("Initialization failed.\n");
-						*mxGetPr(plhs[0]) = 0;
-					}
-					else
-						*mxGetPr(plhs[0]) = 1;
+				mexPrintf("Command could not be queued.\n");
+				*mxGetPr(plhs[0]) = 0;
 			}
-		} // end of nrhs>1
-	} // end of nrhs>0
+			else
+				*mxGetPr(plhs[0]) = 1;
+		}
+		else
+			mexPrintf("ERROR: uncorrect use of 'command' option.\n");
+	}
 	else
+	{
+		mexPrintf("Uncorrect call to this function.\n\n");
 		helpOptions();
+		*mxGetPr(plhs[0]) = 0;
+	}
 
 	return;
 
@@ -0,0 +1,90 @@
+// MexLoadDatalog.cpp : loads a JSBSim CSV datalog into Matlab
+//
+//   [data, names, map] = MexLoadDatalog(file [, columns [, threads]])
+//
+//   data     one row per logged step, one column per selected datalog column
+//   names    cell array of the selected column names, as in the file header
+//   map      containers.Map from a column name to its column in data
+//   columns  cell array of names or vector of (1-based) column numbers,
+//            [] or omitted for all columns; unknown ones come back as NaN
+//   threads  number of parser threads, 0 or omitted for all cores
+
+#include "StdAfx.h"
+#include "mex.h"
+#include <string>
+#include <vector>
+#include <map>
+#include "DatalogReader.h"
+
+using namespace std;
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs < 1 || !mxIsChar(prhs[0]))
+		mexErrMsgTxt("usage: [data, names, map] = MexLoadDatalog(file [, columns [, threads]])");
+
+	char *file = mxArrayToString(prhs[0]);
+	DatalogReader reader;
+	bool opened = reader.Open(string(file));
+	mxFree(file);
+	if (!opened)
+		mexErrMsgTxt("Datalog could not be opened, or is empty.");
+	const vector<string>& all = reader.GetColumnNames();
+
+	vector<int> columns;
+	if (nrhs < 2 || mxIsEmpty(prhs[1]))
+		for (unsigned i=0; i<all.size(); i++)
+			columns.push_back(i);
+	else if (mxIsCell(prhs[1]))
+		for (mwIndex i=0; i<mxGetNumberOfElements(prhs[1]); i++)
+		{
+			char *name = mxArrayToString(mxGetCell(prhs[1],i));
+			int c = name ? reader.FindColumn(string(name)) : -1;
+			if (c < 0)
+				mexPrintf("Column '%s' is not in the datalog.\n", name ? name : "");
+			columns.push_back(c);
+			mxFree(name);
+		}
+	else if (mxIsDouble(prhs[1]))
+		for (mwIndex i=0; i<mxGetNumberOfElements(prhs[1]); i++)
+			columns.push_back((int) mxGetPr(prhs[1])[i] - 1);
+	else
+		mexErrMsgTxt("columns must be a cell array of names or a vector of column numbers.");
+	int threads = (nrhs > 2) ? (int) mxGetScalar(prhs[2]) : 0;
+
+	// the matrix is sized once the rows are counted and filled in place
+	size_t rows = reader.CountRows(threads);
+	plhs[0] = mxCreateDoubleMatrix(rows, columns.size(), mxREAL);
+	if (rows > 0 && !columns.empty())
+		reader.Parse(columns, mxGetPr(plhs[0]));
+
+	if (nlhs > 1)
+	{
+		plhs[1] = mxCreateCellMatrix(1, columns.size());
+		for (unsigned k=0; k<columns.size(); k++)
+		{
+			int c = columns[k];
+			mxSetCell(plhs[1], k, mxCreateString((c >= 0 && c < (int)all.size()) ? all[c].c_str() : ""));
+		}
+	}
+	if (nlhs > 2)
+	{
+		// containers.Map(keys, values) of the columns found; a name selected twice maps to its last column
+		map<string, int> index;
+		for (unsigned k=0; k<columns.size(); k++)
+			if (columns[k] >= 0 && columns[k] < (int)all.size())
+				index[all[columns[k]]] = k + 1;
+		mxArray *args[2];
+		args[0] = mxCreateCellMatrix(1, index.size());
+		args[1] = mxCreateCellMatrix(1, index.size());
+		mwIndex i = 0;
+		for (map<string, int>::const_iterator it = index.begin(); it != index.end(); ++it, i++)
+		{
+			mxSetCell(args[0], i, mxCreateString(it->first.c_str()));
+			mxSetCell(args[1], i, mxCreateDoubleScalar(it->second));
+		}
+		mexCallMATLAB(1, &plhs[2], index.empty() ? 0 : 2, args, "containers.Map");
+		mxDestroyArray(args[0]);
+		mxDestroyArray(args[1]);
+	}
+}
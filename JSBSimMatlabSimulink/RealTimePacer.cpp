@@ -0,0 +1,119 @@
+#include "StdAfx.h"
+#include "RealTimePacer.h"
+#include <thread>
+#include <math.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+RealTimePacer::RealTimePacer(void)
+{
+#ifdef _WIN32
+	_spin = 2.0e-3; // Sleep() wakes on the 1 ms (or 15.6 ms) timer tick
+#else
+	_spin = 200.0e-6;
+#endif
+	_cpu = -1;
+	_priority = 0;
+	_dedicated = false;
+	_applied = false;
+	_thread_ok = true;
+	Reset();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void RealTimePacer::Reset(void)
+{
+	_started = false;
+	_frames = 0;
+	_misses = 0;
+	_jitter_frames = 0;
+	_jitter_sum = 0.0;
+	_jitter_sq = 0.0;
+	_jitter_max = 0.0;
+	_overrun_max = 0.0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void RealTimePacer::Wait(double period)
+{
+	using std::chrono::duration;
+	using std::chrono::duration_cast;
+
+	if (!_applied)
+		_thread_ok = ApplyThreadSettings();
+
+	const Clock::duration step = duration_cast<Clock::duration>(duration<double>(period));
+	Clock::time_point now = Clock::now();
+	if (!_started)
+	{
+		// the first frame only sets up the timeline
+		_started = true;
+		_deadline = now + step;
+		return;
+	}
+
+	if (now > _deadline)
+	{
+		double late = duration<double>(now - _deadline).count();
+		if (late > _overrun_max) _overrun_max = late;
+		_misses++;
+		_frames++;
+		_deadline = now + step;
+		return;
+	}
+
+	// coarse sleep, then spin for the last part
+	const Clock::time_point wake = _deadline - duration_cast<Clock::duration>(duration<double>(_spin));
+	if (now < wake)
+		std::this_thread::sleep_until(wake);
+	while ((now = Clock::now()) < _deadline)
+		;
+
+	double jitter = duration<double>(now - _deadline).count();
+	_jitter_frames++;
+	_jitter_sum += jitter;
+	_jitter_sq += jitter*jitter;
+	if (jitter > _jitter_max) _jitter_max = jitter;
+	_frames++;
+	_deadline += step;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+double RealTimePacer::GetRMSJitter(void)
+{
+	return _jitter_frames ? sqrt(_jitter_sq/_jitter_frames) : 0.0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool RealTimePacer::ApplyThreadSettings(void)
+{
+	bool ok = true;
+	_applied = true;
+	if (!_dedicated)
+		return _cpu < 0 && _priority <= 0;
+#ifdef _WIN32
+	if (_cpu >= 0)
+		ok = SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << _cpu) != 0 && ok;
+	if (_priority > 0)
+		ok = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0 && ok;
+#else
+#ifdef __linux__
+	if (_cpu >= 0)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(_cpu, &set);
+		ok = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 && ok;
+	}
+#endif
+	if (_priority > 0)
+	{
+		struct sched_param param;
+		int max = sched_get_priority_max(SCHED_FIFO);
+		param.sched_priority = _priority < max ? _priority : max;
+		ok = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0 && ok;
+	}
+#endif
+	return ok;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -0,0 +1,70 @@
+#ifndef REALTIMEPACER_HEADER_H
+#define REALTIMEPACER_HEADER_H
+
+#include <chrono>
+
+/// Paces a loop against a monotonic clock
+/*
+	Wait(period) blocks until the deadline of the current frame and then
+	moves the deadline on by one period. It sleeps until spin_time before
+	the deadline and busy-waits the rest, which trades a little CPU for
+	wake-up jitter well below the scheduler tick. A frame that is already
+	past its deadline counts as a miss and restarts the timeline from now
+	instead of running the following frames back to back.
+
+	On a dedicated thread, the thread that calls Wait() first is optionally
+	pinned to one CPU and raised to real-time priority (SCHED_FIFO on Linux,
+	which needs CAP_SYS_NICE or a matching rtprio limit; TIME_CRITICAL on
+	Windows). The owner of the thread marks it with SetDedicatedThread and
+	clears the mark once the thread is gone. A pacer waited on by a thread
+	it does not own, such as Matlab's, never touches that thread: the
+	settings would outlive the simulation and spin Matlab at real-time
+	priority, so they count as not applied instead.
+	For the lowest jitter pin to a core isolated from the scheduler, e.g.
+	isolcpus=3 on the kernel command line, and use cpu 3.
+*/
+class RealTimePacer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	RealTimePacer(void);
+	/// Block until the end of the current frame of the given length (s)
+	void Wait(double period);
+	/// Restart the timeline and clear the statistics
+	void Reset(void);
+
+	/// Time spent spinning before each deadline (s)
+	void SetSpinTime(double seconds){_spin = seconds;}
+	/// CPU the pacing thread is pinned to, -1 for any
+	void SetCPU(int cpu){_cpu = cpu; _applied = false;}
+	/// Real-time priority of the pacing thread, 0 keeps the normal scheduler
+	void SetPriority(int priority){_priority = priority; _applied = false;}
+	/// Whether Wait() runs on a thread of our own, which CPU and priority may be applied to
+	void SetDedicatedThread(bool dedicated){_dedicated = dedicated; _applied = false;}
+	/// False if pinning or the priority could not be applied
+	bool ThreadSettingsApplied(){return _thread_ok;}
+
+	long GetFrames(){return _frames;}
+	long GetMisses(){return _misses;}
+	/// Wake-up lateness against the deadline (s), over the frames that were not missed
+	double GetMeanJitter(){return _jitter_frames ? _jitter_sum/_jitter_frames : 0.0;}
+	double GetRMSJitter(void);
+	double GetMaxJitter(){return _jitter_max;}
+	/// Largest lateness of a missed frame (s)
+	double GetMaxOverrun(){return _overrun_max;}
+
+private:
+	bool ApplyThreadSettings(void);
+
+	Clock::time_point _deadline;
+	bool _started;
+	double _spin;
+	int _cpu, _priority;
+	bool _dedicated, _applied, _thread_ok;
+
+	long _frames, _misses, _jitter_frames;
+	double _jitter_sum, _jitter_sq, _jitter_max, _overrun_max;
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
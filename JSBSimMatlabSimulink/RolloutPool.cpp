@@ -0,0 +1,167 @@
+#include "StdAfx.h"
+#include "RolloutPool.h"
+#include <thread>
+#include <chrono>
+#include <limits>
+
+RolloutPool::RolloutPool(void)
+	: _width(0), _live(0L), _K(0), _N(0), _u(0L), _traj(0L), _cost(0L), _next(0), _wall(0.0)
+{
+	JSBSimInterface::GetOutputNames(JISignalMap(), JSBSimInterface::eStatePort, _watch);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+RolloutPool::~RolloutPool(void)
+{
+	Close();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool RolloutPool::Open(JSBSimInterface& live, int workers)
+{
+	Close();
+	if (!live.IsAircraftLoaded()) return 0;
+	if (workers < 1) workers = (int)std::thread::hardware_concurrency();
+	if (workers < 1) workers = 1;
+
+	// the inputs mean what they mean for the live instance
+	JISignalMap map;
+	map.inputs.names = live.GetSignalMap().inputs.names;
+	map.inputs.scales = live.GetSignalMap().inputs.scales;
+	_width = JSBSimInterface::GetInputWidth(map);
+
+	for (int w=0; w<workers; w++)
+	{
+		Worker *worker = new Worker;
+		worker->exec = new FGFDMExec();
+		worker->ji = new JSBSimInterface(worker->exec, live.GetDeltaT(), false);
+		worker->ji->SetVerbosity(JSBSimInterface::eSilent);
+		worker->ji->SetSignalMap(map);
+		worker->ji->SetOutputGroups(0);		// only the watched properties are read
+		worker->u.resize(_width);
+		worker->x.resize(JSBSimInterface::GetOutputWidth(map, JSBSimInterface::eStatePort));
+		worker->fc.resize(JSBSimInterface::GetOutputWidth(map, JSBSimInterface::eFCSPort));
+		worker->p.resize(JSBSimInterface::GetOutputWidth(map, JSBSimInterface::ePropulsionPort));
+		worker->c.resize(JSBSimInterface::GetOutputWidth(map, JSBSimInterface::eCalculatedPort));
+		_workers.push_back(worker);
+		if (!worker->ji->Open(live.fdmExec->GetModelName()))
+		{
+			Close();
+			return 0;
+		}
+	}
+	return SetWatch(_watch);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void RolloutPool::Close(void)
+{
+	for (unsigned w=0; w<_workers.size(); w++)
+	{
+		delete _workers[w]->ji;
+		delete _workers[w]->exec;
+		delete _workers[w];
+	}
+	_workers.clear();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool RolloutPool::SetWatch(const vector<string>& names)
+{
+	_watch = names;
+	for (unsigned w=0; w<_workers.size(); w++)
+	{
+		Worker& worker = *_workers[w];
+		worker.watch.resize(names.size());
+		for (unsigned j=0; j<names.size(); j++)
+		{
+			worker.watch[j] = worker.exec->GetPropertyManager()->GetNode(names[j]);
+			if (!worker.watch[j])
+			{
+				worker.watch.clear();
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void RolloutPool::SetCost(const vector<double>& weights, const vector<double>& refs,
+						  const vector<double>& input_weights)
+{
+	_weights = weights;
+	_refs = refs;
+	_input_weights = input_weights;
+	_weights.resize(_watch.size(), 0.0);
+	_refs.resize(_watch.size(), 0.0);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool RolloutPool::Rollout(JSBSimInterface& live, int K, int N, const double *u, double *traj, double *cost)
+{
+	if (!IsOpen() || K < 1 || N < 1 || _workers[0]->watch.size() != _watch.size()) return 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	live.TakeSnapshot(_snapshot);
+	_live = &live;
+	_weights.resize(_watch.size(), 0.0);
+	_refs.resize(_watch.size(), 0.0);
+	_K = K;
+	_N = N;
+	_u = u;
+	_traj = traj;
+	_cost = cost;
+	_next.store(0);
+
+	int threads = (int)_workers.size() < K ? (int)_workers.size() : K;
+	vector<std::thread> pool;
+	for (int w=1; w<threads; w++)
+		pool.push_back(std::thread(&RolloutPool::WorkerLoop, this, w));
+	WorkerLoop(0); // the calling thread is worker 0
+	for (unsigned t=0; t<pool.size(); t++)
+		pool[t].join();
+
+	_live = 0L;
+	_u = 0L;
+	_traj = _cost = 0L;
+	_wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void RolloutPool::WorkerLoop(int id)
+{
+	int k;
+	while ((k = _next.fetch_add(1)) < _K)
+		RunCandidate(*_workers[id], k);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void RolloutPool::RunCandidate(Worker& worker, int k)
+{
+	const size_t width = _width, watched = _watch.size();
+	double *traj = _traj + (size_t)k*_N*watched;
+	// the live instance is not stepped while a rollout runs, reading it is safe
+	worker.ji->CopySchedule(*_live);
+	if (!worker.ji->RestoreSnapshot(_snapshot))
+	{
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		for (size_t i=0; i<(size_t)_N*watched; i++)
+			traj[i] = nan;
+		_cost[k] = nan;
+		return;
+	}
+
+	double cost = 0.0;
+	const size_t inputs_weighted = _input_weights.size() < width ? _input_weights.size() : width;
+	for (int n=0; n<_N; n++)
+	{
+		const double *u = _u + ((size_t)k*_N + n)*width;
+		worker.u.assign(u, u + width);
+		worker.ji->UpdateStates(&worker.u[0], &worker.x[0], &worker.fc[0], &worker.p[0], &worker.c[0]);
+		for (size_t j=0; j<watched; j++)
+		{
+			const double y = worker.watch[j]->getDoubleValue();
+			const double d = y - _refs[j];
+			traj[n*watched + j] = y;
+			cost += _weights[j]*d*d;
+		}
+		for (size_t i=0; i<inputs_weighted; i++)
+			cost += _input_weights[i]*u[i]*u[i];
+	}
+	_cost[k] = cost;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -0,0 +1,85 @@
+#ifndef ROLLOUTPOOL_HEADER_H
+#define ROLLOUTPOOL_HEADER_H
+
+#include "JSBSimInterface.h"
+#include <atomic>
+
+/// Rolls candidate input sequences forward from a live instance's state, in parallel
+/*
+	For model-predictive control: every control frame Rollout() snapshots
+	the live instance (JSBSimInterface::TakeSnapshot), and K candidate
+	sequences of N input vectors are each restored from that snapshot into
+	one of a pool of private, pre-loaded instances and stepped N times with
+	UpdateStates, as the live instance would be: at its multiplier, with
+	its adaptive multiplier settings and model rates (CopySchedule). The
+	watched properties are recorded after every step and a quadratic cost
+	is summed on the way:
+		cost = sum over steps of  sum_j w_j (y_j - r_j)^2 + sum_i q_i u_i^2
+	Weights left out count as zero, so a caller that wants another cost
+	computes it from the trajectories.
+
+	The pool instances are loaded once by Open(), on the calling thread,
+	with the live instance's aircraft, dt and signal map inputs; Rollout()
+	only restores and steps. Candidates are handed out one at a time from
+	an atomic counter to one thread per instance, the calling thread being
+	the first; workers never call the MEX API (UpdateStates makes no such
+	call on silent instances). A restore starts every
+	candidate the same way whichever instance runs it, with the limits
+	listed at TakeSnapshot.
+*/
+class RolloutPool
+{
+public:
+	RolloutPool(void);
+	~RolloutPool(void);
+
+	/// Load workers instances (0 = one per core) like the live one, false if one fails
+	bool Open(JSBSimInterface& live, int workers);
+	void Close(void);
+	bool IsOpen(){return !_workers.empty();}
+	int GetNumWorkers(){return (int)_workers.size();}
+	/// Length of one input vector, as UpdateStates takes it
+	int GetInputWidth(){return _width;}
+
+	/// Properties recorded after every step, the 12 states by default
+	bool SetWatch(const vector<string>& names);
+	const vector<string>& GetWatch(){return _watch;}
+	/// Weights w and references r per watched property, weights q per input
+	void SetCost(const vector<double>& weights, const vector<double>& refs, const vector<double>& input_weights);
+
+	/// Roll K candidates of N steps each from the live instance's current state
+	/*
+		u holds the inputs as u[i + width*(n + N*k)], traj receives the
+		watched properties as traj[j + watched*(n + N*k)] and cost one
+		value per candidate; a candidate that cannot be restored gets NaN.
+	*/
+	bool Rollout(JSBSimInterface& live, int K, int N, const double *u, double *traj, double *cost);
+	/// Wall clock seconds of the last Rollout()
+	double GetLastTime(){return _wall;}
+
+private:
+	struct Worker
+	{
+		FGFDMExec *exec;
+		JSBSimInterface *ji;
+		vector<FGPropertyManager*> watch;
+		vector<double> u, x, fc, p, c;
+	};
+	void WorkerLoop(int id);
+	void RunCandidate(Worker& worker, int k);
+
+	vector<Worker*> _workers;
+	vector<string> _watch;
+	vector<double> _weights, _refs, _input_weights;
+	int _width;
+	JISnapshot _snapshot;
+	// the Rollout() in progress
+	JSBSimInterface *_live;
+	int _K, _N;
+	const double *_u;
+	double *_traj, *_cost;
+	std::atomic<int> _next;
+	double _wall;
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
@@ -0,0 +1,141 @@
+#include "StdAfx.h"
+#include "ShmPublisher.h"
+#include <string.h>
+#include <new>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+static const uint32_t kNameSize = 64;
+
+ShmPublisher::ShmPublisher(void)
+{
+	_size = 0;
+	_taken = false;
+	_header = 0L;
+	_data = 0L;
+#ifdef _WIN32
+	_mapping = 0L;
+#else
+	_fd = -1;
+#endif
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+ShmPublisher::~ShmPublisher(void)
+{
+	Close();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool ShmPublisher::Open(const string name, const vector<string>& signals)
+{
+	Close();
+	_taken = false;
+
+	const size_t names_offset = (sizeof(ShmHeader) + 7) & ~(size_t)7;
+	const size_t data_offset = names_offset + signals.size()*kNameSize;
+	_size = data_offset + (signals.size() + 1)*sizeof(double);
+	void *base = 0L;
+
+#ifdef _WIN32
+	_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		0, (DWORD)_size, name.c_str());
+	if (!_mapping) return 0;
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		CloseHandle((HANDLE)_mapping);
+		_mapping = 0L;
+		_taken = true;
+		return 0;
+	}
+	base = MapViewOfFile((HANDLE)_mapping, FILE_MAP_ALL_ACCESS, 0, 0, _size);
+	if (!base)
+	{
+		CloseHandle((HANDLE)_mapping);
+		_mapping = 0L;
+		return 0;
+	}
+#else
+	// never attach to a segment someone else published, Close() would remove it under them
+	_fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (_fd < 0)
+	{
+		_taken = errno == EEXIST;
+		return 0;
+	}
+	if (ftruncate(_fd, _size) != 0 ||
+		(base = mmap(0, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0)) == MAP_FAILED)
+	{
+		close(_fd);
+		shm_unlink(name.c_str());
+		_fd = -1;
+		return 0;
+	}
+#endif
+	_name = name;
+	memset(base, 0, _size);
+
+	// names first, then the header that makes the segment valid for readers
+	char *names = (char *)base + names_offset;
+	for (size_t i=0; i<signals.size(); i++)
+		strncpy(names + i*kNameSize, signals[i].c_str(), kNameSize - 1);
+	_data = (double *)((char *)base + data_offset);
+
+	_header = new (base) ShmHeader;
+	_header->layout = 1;
+	_header->header_size = sizeof(ShmHeader);
+	_header->num_signals = (uint32_t)signals.size();
+	_header->name_size = kNameSize;
+	_header->names_offset = (uint32_t)names_offset;
+	_header->data_offset = (uint32_t)data_offset;
+	_header->seq.store(0, std::memory_order_relaxed);
+	_header->reserved = 0;
+	_header->frames = 0;
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(_header->magic, "JSBSIM\0\0", 8);
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void ShmPublisher::Close(void)
+{
+	if (!_header) return;
+#ifdef _WIN32
+	UnmapViewOfFile(_header);
+	CloseHandle((HANDLE)_mapping);
+	_mapping = 0L;
+#else
+	munmap(_header, _size);
+	close(_fd);
+	shm_unlink(_name.c_str());
+	_fd = -1;
+#endif
+	_header = 0L;
+	_data = 0L;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void ShmPublisher::BeginFrame(double time)
+{
+	if (!_header) return;
+	_header->seq.store(_header->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	_data[0] = time;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void ShmPublisher::Write(int offset, const double *ptr, int n)
+{
+	if (!_header || offset < 0 || offset + n > (int)_header->num_signals) return;
+	memcpy(_data + 1 + offset, ptr, n*sizeof(double));
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void ShmPublisher::EndFrame(void)
+{
+	if (!_header) return;
+	_header->frames++;
+	_header->seq.store(_header->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -0,0 +1,79 @@
+#ifndef SHMPUBLISHER_HEADER_H
+#define SHMPUBLISHER_HEADER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using std::string;
+using std::vector;
+
+/// Header at the start of the shared-memory segment
+/*
+	Segment layout (all offsets in bytes from the start of the segment):
+		ShmHeader
+		names	num_signals entries of name_size bytes, NUL padded
+		data	double[1 + num_signals]: JSBSim sim-time (s) of the signals, then the signals
+
+	seq is odd while the publisher writes a frame. A reader copies the data
+	between two reads of seq and keeps the copy only if both reads returned
+	the same even value, otherwise it tries again:
+		do { s1 = seq (acquire); copy data; s2 = seq (acquire); } while (s1 & 1 || s1 != s2);
+	frames counts the frames published since the segment was created.
+*/
+struct ShmHeader
+{
+	char magic[8];				// "JSBSIM\0\0"
+	uint32_t layout;			// 1
+	uint32_t header_size;		// sizeof(ShmHeader)
+	uint32_t num_signals;
+	uint32_t name_size;
+	uint32_t names_offset;
+	uint32_t data_offset;
+	std::atomic<uint32_t> seq;
+	uint32_t reserved;
+	uint64_t frames;
+};
+
+/// Publishes frames of named signals into a shared-memory segment
+/*
+	The segment is a POSIX shm object (shm_open name, e.g. "/jsbsim_c172")
+	or a named file mapping on Windows. It is created when opened, and
+	opening fails if the name is already in use, by another block or a
+	publisher that crashed before removing it (rm /dev/shm/<name>). It is
+	removed on Close(); readers that still have it mapped keep their view.
+	The publisher never waits for readers.
+*/
+class ShmPublisher
+{
+public:
+	ShmPublisher(void);
+	~ShmPublisher(void);
+
+	/// Create the segment for the given signal names
+	bool Open(const string name, const vector<string>& signals);
+	/// True if the last Open() failed because the name was in use
+	bool WasNameTaken(){return _taken;}
+	void Close(void);
+	bool IsOpen(){return _header != 0L;}
+
+	/// Publish a frame: BeginFrame, Write the parts at their signal offsets, EndFrame
+	void BeginFrame(double time);
+	void Write(int offset, const double *ptr, int n);
+	void EndFrame(void);
+
+private:
+	string _name;
+	size_t _size;
+	bool _taken;
+	ShmHeader *_header;
+	double *_data;
+#ifdef _WIN32
+	void *_mapping;
+#else
+	int _fd;
+#endif
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
@@ -0,0 +1,173 @@
+#include "StdAfx.h"
+#include "StatReducer.h"
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+P2Quantile::P2Quantile(double p)
+{
+	_p = (p < 0.0) ? 0.0 : (p > 1.0 ? 1.0 : p);
+	Reset();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void P2Quantile::Reset(void)
+{
+	_count = 0;
+	for (int i=0; i<5; i++)
+	{
+		_q[i] = 0.0;
+		_n[i] = i;
+	}
+	_np[0] = 0.0;
+	_np[1] = 2.0*_p;
+	_np[2] = 4.0*_p;
+	_np[3] = 2.0 + 2.0*_p;
+	_np[4] = 4.0;
+	_dn[0] = 0.0;
+	_dn[1] = 0.5*_p;
+	_dn[2] = _p;
+	_dn[3] = 0.5*(1.0 + _p);
+	_dn[4] = 1.0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void P2Quantile::Add(double x)
+{
+	// the first five samples are the initial marker heights
+	if (_count < 5)
+	{
+		_q[_count++] = x;
+		if (_count == 5) std::sort(_q, _q + 5);
+		return;
+	}
+	_count++;
+
+	// cell k holding x, extending the extreme markers if needed
+	int k;
+	if (x < _q[0])       { _q[0] = x; k = 0; }
+	else if (x < _q[1])  k = 0;
+	else if (x < _q[2])  k = 1;
+	else if (x < _q[3])  k = 2;
+	else if (x <= _q[4]) k = 3;
+	else                 { _q[4] = x; k = 3; }
+
+	for (int i=k+1; i<5; i++) _n[i] += 1.0;
+	for (int i=0; i<5; i++) _np[i] += _dn[i];
+
+	// move the middle markers towards their desired positions
+	for (int i=1; i<4; i++)
+	{
+		double d = _np[i] - _n[i];
+		if ((d >= 1.0 && _n[i+1] - _n[i] > 1.0) || (d <= -1.0 && _n[i-1] - _n[i] < -1.0))
+		{
+			d = (d > 0.0) ? 1.0 : -1.0;
+			double q = Parabolic(i, d);
+			if (_q[i-1] < q && q < _q[i+1])
+				_q[i] = q;
+			else
+				_q[i] = Linear(i, d);
+			_n[i] += d;
+		}
+	}
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+double P2Quantile::Parabolic(int i, double d) const
+{
+	return _q[i] + d/(_n[i+1] - _n[i-1]) *
+		((_n[i] - _n[i-1] + d)*(_q[i+1] - _q[i])/(_n[i+1] - _n[i]) +
+		 (_n[i+1] - _n[i] - d)*(_q[i] - _q[i-1])/(_n[i] - _n[i-1]));
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+double P2Quantile::Linear(int i, double d) const
+{
+	int j = i + (int)d;
+	return _q[i] + d*(_q[j] - _q[i])/(_n[j] - _n[i]);
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+double P2Quantile::Get() const
+{
+	if (_count >= 5) return _q[2];
+	if (_count == 0) return 0.0;
+	// fewer than five samples: the nearest-rank sample quantile
+	double q[5];
+	std::copy(_q, _q + _count, q);
+	std::sort(q, q + _count);
+	return q[(int)floor(_p*(_count - 1) + 0.5)];
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+SignalStats::SignalStats(void)
+{
+	_has_threshold = false;
+	_above = true;
+	_threshold = 0.0;
+	Reset();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void SignalStats::AddQuantile(double p)
+{
+	_quantiles.push_back(P2Quantile(p));
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void SignalStats::SetThreshold(double threshold, bool above)
+{
+	_has_threshold = true;
+	_threshold = threshold;
+	_above = above;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void SignalStats::Reset(void)
+{
+	_count = 0;
+	_nan_count = 0;
+	_mean = 0.0;
+	_m2 = 0.0;
+	_min = DBL_MAX;
+	_max = -DBL_MAX;
+	_t_min = 0.0;
+	_t_max = 0.0;
+	for (unsigned i=0; i<_quantiles.size(); i++)
+		_quantiles[i].Reset();
+	_beyond = false;
+	_t_last = 0.0;
+	_exceed_count = 0;
+	_exceed_events = 0;
+	_exceed_time = 0.0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void SignalStats::Add(double t, double x)
+{
+	if (x != x)
+	{
+		_nan_count++;
+		return;
+	}
+
+	_count++;
+	double delta = x - _mean;
+	_mean += delta/_count;
+	_m2 += delta*(x - _mean);
+
+	if (x < _min) { _min = x; _t_min = t; }
+	if (x > _max) { _max = x; _t_max = t; }
+
+	for (unsigned i=0; i<_quantiles.size(); i++)
+		_quantiles[i].Add(x);
+
+	if (_has_threshold)
+	{
+		bool beyond = _above ? (x > _threshold) : (x < _threshold);
+		if (beyond)
+		{
+			_exceed_count++;
+			if (!_beyond) _exceed_events++;
+			else _exceed_time += t - _t_last; // the interval is counted once both ends are beyond
+		}
+		_beyond = beyond;
+	}
+	_t_last = t;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+double SignalStats::GetStd() const
+{
+	return sqrt(GetVariance());
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
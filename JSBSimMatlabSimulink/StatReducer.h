@@ -0,0 +1,90 @@
+#ifndef STATREDUCER_HEADER_H
+#define STATREDUCER_HEADER_H
+
+#include <vector>
+
+using std::vector;
+
+/// Streaming estimate of one quantile
+/*
+	P-square algorithm (Jain and Chlamtac, 1985): five markers whose
+	heights are adjusted with a piecewise-parabolic fit as samples arrive,
+	constant memory and time per sample. Exact for the first five samples,
+	typically within a fraction of a percent of the sample quantile for
+	smooth distributions once a few hundred samples were seen.
+*/
+class P2Quantile
+{
+public:
+	explicit P2Quantile(double p);
+	void Add(double x);
+	void Reset(void);
+	double GetP() const {return _p;}
+	/// Current estimate, 0 before the first sample
+	double Get() const;
+
+private:
+	double Parabolic(int i, double d) const;
+	double Linear(int i, double d) const;
+
+	double _p;
+	int _count;
+	double _q[5];		// marker heights
+	double _n[5];		// marker positions
+	double _np[5];		// desired positions
+	double _dn[5];		// increments of the desired positions
+};
+
+/// Running summary of one signal, fed one sample per step
+/*
+	Moments use Welford's update, so the variance stays accurate over
+	millions of samples. Extrema keep the time they were reached at.
+	A threshold counts the samples beyond it, the time spent beyond it
+	and the number of separate excursions. NaN samples are only counted.
+*/
+class SignalStats
+{
+public:
+	SignalStats(void);
+
+	/// Configuration, kept by Reset()
+	void AddQuantile(double p);
+	void SetThreshold(double threshold, bool above);
+	void Reset(void);
+
+	void Add(double t, double x);
+
+	unsigned long GetCount() const {return _count;}
+	unsigned long GetNaNCount() const {return _nan_count;}
+	double GetMean() const {return _mean;}
+	double GetVariance() const {return _count > 1 ? _m2/(_count - 1) : 0.0;}
+	double GetStd() const;
+	double GetMin() const {return _min;}
+	double GetMinTime() const {return _t_min;}
+	double GetMax() const {return _max;}
+	double GetMaxTime() const {return _t_max;}
+
+	int GetNumQuantiles() const {return (int)_quantiles.size();}
+	double GetQuantileP(int i) const {return _quantiles[i].GetP();}
+	double GetQuantile(int i) const {return _quantiles[i].Get();}
+
+	bool HasThreshold() const {return _has_threshold;}
+	double GetThreshold() const {return _threshold;}
+	bool IsUpperThreshold() const {return _above;}
+	unsigned long GetExceedances() const {return _exceed_count;}
+	unsigned long GetExceedanceEvents() const {return _exceed_events;}
+	double GetExceedanceTime() const {return _exceed_time;}
+
+private:
+	unsigned long _count, _nan_count;
+	double _mean, _m2;
+	double _min, _t_min, _max, _t_max;
+	vector<P2Quantile> _quantiles;
+
+	bool _has_threshold, _above, _beyond;
+	double _threshold, _t_last;
+	unsigned long _exceed_count, _exceed_events;
+	double _exceed_time;
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
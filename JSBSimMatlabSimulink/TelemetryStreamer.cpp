@@ -0,0 +1,174 @@
+#include "StdAfx.h"
+#include "TelemetryStreamer.h"
+#include <string.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+TelemetryStreamer::TelemetryStreamer(void)
+{
+	_socket_open = false;
+	_socket = 0;
+	_num_signals = 0;
+	_decimation = 1;
+	_frame = 0;
+	_delta = false;
+	_keyframe_interval = 50;
+	_seq = 0;
+	_sent = 0;
+	_dropped = 0;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+TelemetryStreamer::~TelemetryStreamer(void)
+{
+	Close();
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool TelemetryStreamer::Open(const string destination, int num_signals, int decimation, bool delta)
+{
+	Close();
+	if (num_signals <= 0 || num_signals > MaxSignals) return 0;
+
+	int family;
+	if (destination.compare(0, 4, "udp:") == 0)
+	{
+		size_t colon = destination.rfind(':');
+		if (colon <= 4) return 0;
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons((unsigned short)atoi(destination.c_str() + colon + 1));
+		if (inet_pton(AF_INET, destination.substr(4, colon - 4).c_str(), &addr.sin_addr) != 1) return 0;
+		_address.assign((char *)&addr, (char *)&addr + sizeof(addr));
+		family = AF_INET;
+	}
+#ifndef _WIN32
+	else if (destination.compare(0, 5, "unix:") == 0)
+	{
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (destination.size() - 5 >= sizeof(addr.sun_path)) return 0;
+		strcpy(addr.sun_path, destination.c_str() + 5);
+		_address.assign((char *)&addr, (char *)&addr + sizeof(addr));
+		family = AF_UNIX;
+	}
+#endif
+	else
+		return 0;
+
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2,2), &wsa) != 0) return 0;
+	SOCKET s = socket(family, SOCK_DGRAM, 0);
+	if (s == INVALID_SOCKET) { WSACleanup(); return 0; }
+	u_long nonblocking = 1;
+	ioctlsocket(s, FIONBIO, &nonblocking);
+	_socket = (uintptr_t)s;
+#else
+	_socket = socket(family, SOCK_DGRAM, 0);
+	if (_socket < 0) return 0;
+	fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL) | O_NONBLOCK);
+#endif
+	_socket_open = true;
+
+	_num_signals = num_signals;
+	_decimation = decimation < 1 ? 1 : decimation;
+	_delta = delta;
+	_frame = 0;
+	_seq = 0;
+	_sent = 0;
+	_dropped = 0;
+	_last.assign(num_signals, 0.0);
+	_packet.resize(sizeof(TelemetryHeader) + (num_signals + 7)/8 + num_signals*sizeof(double));
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void TelemetryStreamer::Close(void)
+{
+	if (!_socket_open) return;
+#ifdef _WIN32
+	closesocket((SOCKET)_socket);
+	WSACleanup();
+#else
+	close(_socket);
+#endif
+	_socket_open = false;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+bool TelemetryStreamer::Due(void)
+{
+	if (!_socket_open) return 0;
+	if (++_frame < _decimation) return 0;
+	_frame = 0;
+	return 1;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+void TelemetryStreamer::Send(double time, const double *values)
+{
+	TelemetryHeader header;
+	header.magic = 0x5442534A; // "JSBT" in memory on little endian machines
+	header.version = 1;
+	header.seq = _seq;
+	header.num_signals = (uint16_t)_num_signals;
+	header.time = time;
+
+	char *body = &_packet[0] + sizeof(TelemetryHeader);
+	const bool delta = _delta && (_seq % _keyframe_interval) != 0;
+	size_t bytes;
+	if (delta)
+	{
+		const int mask_bytes = (_num_signals + 7)/8;
+		unsigned char *mask = (unsigned char *)body;
+		double *out = (double *)(body + mask_bytes);
+		int count = 0;
+		memset(mask, 0, mask_bytes);
+		for (int i=0; i<_num_signals; i++)
+			if (memcmp(&values[i], &_last[i], sizeof(double)) != 0)
+			{
+				mask[i >> 3] |= (unsigned char)(1 << (i & 7));
+				memcpy(&out[count++], &values[i], sizeof(double));
+			}
+		header.flags = 1;
+		header.count = (uint16_t)count;
+		bytes = sizeof(TelemetryHeader) + mask_bytes + count*sizeof(double);
+	}
+	else
+	{
+		memcpy(body, values, _num_signals*sizeof(double));
+		header.flags = 0;
+		header.count = (uint16_t)_num_signals;
+		bytes = sizeof(TelemetryHeader) + _num_signals*sizeof(double);
+	}
+	memcpy(&_packet[0], &header, sizeof(header));
+
+#ifdef _WIN32
+	int rc = sendto((SOCKET)_socket, &_packet[0], (int)bytes, 0,
+		(const struct sockaddr *)&_address[0], (int)_address.size());
+#else
+	ssize_t rc = sendto(_socket, &_packet[0], bytes, 0,
+		(const struct sockaddr *)&_address[0], (socklen_t)_address.size());
+#endif
+	if (rc < 0)
+	{
+		// nobody listening or the socket buffer is full: drop the frame and
+		// force a key frame next, the receiver's reference is unknown now
+		_dropped++;
+		_seq += _keyframe_interval - (_seq % _keyframe_interval);
+		return;
+	}
+	memcpy(&_last[0], values, _num_signals*sizeof(double));
+	_sent++;
+	_seq++;
+}
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
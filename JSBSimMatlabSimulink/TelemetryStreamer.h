@@ -0,0 +1,77 @@
+#ifndef TELEMETRYSTREAMER_HEADER_H
+#define TELEMETRYSTREAMER_HEADER_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using std::string;
+using std::vector;
+
+/// Header of a telemetry datagram, native byte order
+/*
+	A key frame (flags bit 0 clear) carries all num_signals values as
+	doubles. A delta frame (bit 0 set) carries a bit mask of
+	(num_signals+7)/8 bytes, bit i set if signal i changed since the
+	previous datagram, followed by count doubles for the changed signals
+	in signal order. Every keyframe_interval-th datagram is a key frame so
+	that a receiver that joins late, or missed a datagram (a gap in seq),
+	is consistent again after at most that many datagrams.
+*/
+struct TelemetryHeader
+{
+	uint32_t magic;			// 'JSBT'
+	uint16_t version;		// 1
+	uint16_t flags;			// bit 0: delta frame
+	uint32_t seq;			// datagram number, skips ahead after a dropped one
+	uint16_t num_signals;
+	uint16_t count;			// doubles that follow (the mask of a delta frame first)
+	double time;			// simulation time (s)
+};
+
+/// Sends decimated frames of a fixed signal set as datagrams
+/*
+	Destinations are "udp:<host>:<port>" (IPv4, normally 127.0.0.1) or
+	"unix:<path>" for a Unix datagram socket (not on Windows). Sends never
+	block: a datagram the socket cannot take right now is dropped and
+	counted, the simulation is never held up by a slow receiver.
+*/
+class TelemetryStreamer
+{
+public:
+	enum {MaxSignals = 1024};
+
+	TelemetryStreamer(void);
+	~TelemetryStreamer(void);
+
+	/// Open the socket; every decimation-th frame is sent, delta enables delta frames
+	bool Open(const string destination, int num_signals, int decimation, bool delta);
+	void Close(void);
+	bool IsOpen(){return _socket_open;}
+
+	/// Counts the frame, true when it is to be sent
+	bool Due(void);
+	/// Send the values of a due frame
+	void Send(double time, const double *values);
+
+	unsigned GetSent(){return _sent;}
+	unsigned GetDropped(){return _dropped;}
+
+private:
+	bool _socket_open;
+#ifdef _WIN32
+	uintptr_t _socket;
+#else
+	int _socket;
+#endif
+	vector<char> _address;	// sockaddr of the destination
+	int _num_signals, _decimation, _frame;
+	bool _delta;
+	int _keyframe_interval;
+	uint32_t _seq;
+	unsigned _sent, _dropped;
+	vector<double> _last;
+	vector<char> _packet;
+};
+//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+#endif
@@ -29,6 +29,71 @@
 %  * [throttle-cmd-norm aileron-cmd-norm elevator-cmd-norm rudder-cmd-norm mixture-cmd-norm set-running flaps-cmd-norm gear-cmd-norm],
 %  * [delta_T], 'verbosity'
 %  * Verbosity can either be set to 'Silent', 'Verbose', 'VeryVerbose' or 'Debug'
+%  * An optional 7th parameter 'IC_options' is a structure array with fields name/value, in the same
+%  * form as the MexJSBSim 'init' structure. Its entries are passed to JSBSimInterface::Init after the
+%  * initial conditions, e.g. to select higher order integrators for a larger [delta_T] in fast-time runs:
+%  *   opts(1).name = 'integrator/rate/rotational';    opts(1).value = 4; % Adams-Bashforth 3
+%  *   opts(2).name = 'integrator/rate/translational'; opts(2).value = 4;
+%  * See JSBSimInterface.h for the stability/accuracy table of the integrators.
+%  * Setting 'adaptive/tolerance' > 0 (and optionally 'adaptive/min-substeps', 'adaptive/max-substeps')
+%  * replaces the fixed multiplier by an adaptive number of JSBSim substeps per Simulink step; the
+%  * Simulink step stays delta_T * multiplier long.
+%  * 'rate/propulsion', 'rate/atmosphere', 'rate/auxiliary', 'rate/aerodynamics' and 'rate/massbalance'
+%  * set how many JSBSim frames pass between runs of that model (outputs are held in between).
+%  * Init spools the engines up to the commanded power before the first step, see SpoolUpEngines;
+%  * 'spool-up/max-iterations' (0 = off) and 'spool-up/tolerance' tune it.
+%  * 'realtime/factor' = 1 paces each Simulink step to the wall clock (2 = twice as fast), with
+%  * 'realtime/cpu' (pin the JSBSim thread to a core), 'realtime/priority' (1..99, real-time scheduling)
+%  * and 'realtime/spin-us' (busy-wait before each deadline). Misses and jitter are printed at the end.
+%  * The core and priority need 'sfun/pipelined' = 1: Matlab's own thread is never pinned or raised.
+%  * Entries starting with 'sfun/' are read by the S-function itself:
+%  *   'sfun/propulsion-rate', 'sfun/calculated-rate'  update the propulsion / calculated output ports only
+%  *                                                   every n-th JSBSim frame (default 1)
+%  *   'sfun/pipelined'                                1 runs each JSBSim frame on a worker thread while Simulink
+%  *                                                   evaluates the rest of the diagram; all outputs then lag the
+%  *                                                   inputs by one frame and JSBSim output is silenced
+%  *   'sfun/shm-name'                                 a name such as '/jsbsim_c172' publishes every frame's states,
+%  *                                                   flight control and calculated outputs, with their names, to that
+%  *                                                   shared-memory segment, which must not exist yet; the frame time is
+%  *                                                   JSBSim's sim-time; see ShmPublisher.h for the layout
+%  *   'sfun/mat-file'                                 a file such as 'run42.mat' receives every frame's states and
+%  *                                                   gathered outputs, written as a MAT-file when the simulation
+%  *                                                   ends; see JSBSimInterface::OpenMatFile for the variables
+%  *   'sfun/journal'                                  a file such as 'run42.jrn' records the init, the inputs of every
+%  *                                                   frame and a state hash every 'sfun/journal-every' frames (100);
+%  *                                                   MexJSBSim('replay', file) re-runs it without Simulink
+%  *   'sfun/checkpoint-out', 'sfun/checkpoint-in'     save the simulation state to that file when the simulation ends,
+%  *                                                   or start from a saved one instead of the IC (same aircraft and dt);
+%  *                                                   see JSBSimInterface::TakeSnapshot for what is not carried over
+%  * Flight control, propulsion and calculated outputs are only gathered from JSBSim when their port is
+%  * connected (and, for the slower ports, on the frames they sample).
+%  * An optional 8th parameter 'IC_signal_map' names a signal map file (pass [] as IC_options if unused).
+%  * It lists the property paths, and optionally units, of the flight control, propulsion and calculated
+%  * output ports; those ports are then sized to their list and filled from property nodes resolved once
+%  * when the aircraft is loaded. See JISignalMap in JSBSimInterface.h for the format, e.g.
+%  *   output 3 velocities/vc-kts
+%  *   output 3 attitude/theta-rad deg
+%  * The map can also replace the 8 control inputs by its own list of input properties; a [*] in the
+%  * path sets that property on every engine:
+%  *   input fcs/throttle-cmd-norm[*]
+%  *   input fcs/speedbrake-cmd-norm
+%  * and stream a set of properties as UDP or Unix datagrams to local tools, every n-th frame:
+%  *   stream velocities/vc-kts
+%  *   stream-to udp:127.0.0.1:5500
+%  *   stream-every 4
+%  * Stop conditions end the simulation as soon as one holds after a JSBSim step; the condition and
+%  * its sim time are printed at the end:
+%  *   stop gear/wow > 0
+%  *   stop position/h-agl-ft < 50
+%  *   stop nan
+%  * and keep running statistics of properties, printed at the end (quantiles, then a threshold):
+%  *   stat accelerations/Nz q 0.5 0.99 > 3.8
+%  * 'record' lines keep a compressed history of properties after every JSBSim step ('record-every n' for
+%  * every n-th), left in the base workspace as JSBSim_history = [sim-time recorded...] at the end:
+%  *   record gear/gear-pos-norm
+%  *   record position/h-sl-ft m
+%  * Sample times are port based: the input port and the state and flight control output ports run at
+%  * the discrete JSBSim frame rate delta_T * multiplier, the two slower ports at a multiple of it.
 %  * The model currently takes 8 control inputs:throttle, aileron, elevator, rudder, mixture, set-running, flaps and gear.
 %  * The model has 12 states:[u-fps v-fps w-fps p-rad-sec q-rad-sec r-rad-sec h-sl-ft long-deg lat-deg phi-rad theta-rad psi-rad] 
 %  * Model has 4 output ports: state vector, control output vector, propulsion output vector and calculated output vector.
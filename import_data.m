@@ -7,6 +7,17 @@ function import_data(FILETOREAD1)
 
 
 
+% JSBSim CSV datalogs go through the MEX loader (see README):
+% datalog holds one row per step, datalog_columns maps a header to its column
+[~, ~, ext] = fileparts(FILETOREAD1);
+if strcmpi(ext, '.csv')
+    [data, names, columns] = MexLoadDatalog(FILETOREAD1);
+    assignin('base', 'datalog', data);
+    assignin('base', 'datalog_names', names);
+    assignin('base', 'datalog_columns', columns);
+    return
+end
+
 % Import the file
 newData1 = load('-mat', FILETOREAD1);
 